@@ -3,6 +3,14 @@
 order=$1
 shift
 
+# "png" asks the generator to rasterize the diagrams itself
+builtin_png=0
+for arg in "$@"; do
+    if [ "$arg" = "png" ] || [ "$arg" = "--png" ]; then
+        builtin_png=1
+    fi
+done
+
 # Initialize
 rm -rf dot/
 rm -rf png/
@@ -15,8 +23,11 @@ status=$?
 
 if [ $status -eq 0 ]; then
     # SVG output is produced directly by the generator (in svg/); no external
-    # tool needed. If Graphviz is available, also rasterize the dot files to PNG.
-    if command -v dot >/dev/null 2>&1; then
+    # tool needed. If Graphviz is available, also rasterize the dot files to PNG
+    # (unless the generator has already written png/ itself).
+    if [ $builtin_png -eq 1 ]; then
+        echo "PNG output was rasterized by the generator (in png/)."
+    elif command -v dot >/dev/null 2>&1; then
         mkdir -p png
         for file in dot/*.dot; do
             # Check if the file exists to avoid errors if no .dot files are found
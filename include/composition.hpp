@@ -0,0 +1,50 @@
+#ifndef COMPOSITION_HPP
+#define COMPOSITION_HPP
+
+#include "enumeration.hpp"
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Improper diagrams by Dyson composition.
+//
+// Cutting every electron bridge of an improper diagram leaves an ordered chain
+// of proper pieces whose orders add up to the diagram's order; phonon lines
+// never cross a bridge, so each piece is itself a proper diagram. Conversely
+// any chain of two or more proper pieces, each joined to the next by a new
+// electron line between one external vertex of each, is improper. An improper
+// run is therefore the proper diagrams of order n plus every distinct chain
+// built from the proper catalogues of orders below n, instead of a scan of
+// the whole reducible candidate space.
+//
+// Each chain is renumbered to the labelling a brute-force run meets first
+// (see first_labelling), so ids, canonical keys and the emitted graphs are
+// exactly those of the scan.
+
+// The diagrams of the run `pieces`, in id order (e.g. enumerate_catalogue, or
+// a cache of earlier runs).
+using CatalogueSource =
+    std::function<std::shared_ptr<const std::vector<SimpleGraph>>(const EnumerationOptions& pieces)>;
+
+// Options for the proper pieces of order `order` of an improper run. Only the
+// filter terms that every piece must satisfy on its own are kept (degree
+// terms and the vertex upper bound); the rest is tested on the whole chain.
+EnumerationOptions piece_options(const EnumerationOptions& options, int order);
+
+// An improper run assembled from `proper` catalogues of orders 1..n. Visits
+// each diagram in id order and returns the count, like enumerate_diagrams.
+long long compose_improper_diagrams(const EnumerationOptions& options, const CatalogueSource& proper,
+                                    const DiagramVisitor& visit);
+
+// Non-skeleton diagrams by self-energy insertion.
+//
+// Replacing every maximal self-energy insertion of a proper diagram by a bare
+// electron line leaves a skeleton of lower order. Conversely, putting a
+// self-energy (any diagram of the improper run: a proper one or a Dyson
+// chain) on one or more internal electron lines of a skeleton gives every
+// proper diagram that is not a skeleton. Returns the number of distinct
+// proper non-skeleton diagrams of options.order, built from the skeleton and
+// improper catalogues of lower orders only.
+long long count_non_skeleton_diagrams(const EnumerationOptions& options, const CatalogueSource& catalogues);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef DOT_WRITER_HPP
+#define DOT_WRITER_HPP
+
+#include "graph.hpp"
+#include <fstream>
+#include <string>
+
+// Append the Graphviz source of diagram G to `out`. The short external
+// electron legs are emitted straight from the initial/final vertex flags as
+// extra zero-size vertices, so G itself is never modified. Vertices carry
+// label, pinned position, size and fill colour for neato; edges their style.
+void append_dot(const SimpleGraph& G, std::string& out, const std::string& name = "G");
+
+// Write diagram G as a standalone .dot file.
+void write_dot(const SimpleGraph& G, const std::string& path);
+
+// Every diagram of a run in one multi-graph DOT file: one "graph graph_<id>"
+// block per diagram, in id order (render with e.g. "dot -Tpng -O").
+class DotStreamWriter {
+public:
+    explicit DotStreamWriter(const std::string& path) : file_(path) {}
+    void add(const SimpleGraph& G, long long id);
+private:
+    std::ofstream file_;
+    std::string buffer_;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef DRAWING_HPP
+#define DRAWING_HPP
+
+#include "graph.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+// 2D point/vector in canvas pixels (y grows downwards).
+struct Vec { double x, y; };
+inline Vec operator+(Vec a, Vec b) { return {a.x + b.x, a.y + b.y}; }
+inline Vec operator-(Vec a, Vec b) { return {a.x - b.x, a.y - b.y}; }
+inline Vec operator*(Vec a, double s) { return {a.x * s, a.y * s}; }
+
+// Stroke widths shared by every output format.
+const double line_width = 1.7;
+const double vertex_stroke_width = 1.3;
+
+// Samples a polyline shifted by -offset (so offset = its origin gives the
+// shape in local coordinates, offset = {0, 0} the absolute one).
+using CurveSampler = std::function<std::vector<Vec>(Vec offset)>;
+
+// Receives a laid-out diagram as drawing primitives. The layout (electron
+// backbone, phonon arcs, self-loops) is computed once by draw_diagram; each
+// output format only decides how to put the primitives on its canvas.
+class DiagramSink {
+public:
+    virtual ~DiagramSink() = default;
+    // Called first, with the canvas size; the background is white.
+    virtual void canvas(double width, double height) = 0;
+    // A straight electron line.
+    virtual void line(Vec a, Vec b) = 0;
+    // A sampled (wavy or bowed) line. Copies with the same `id` (kind, span and
+    // stack level) are the same polyline up to translation, so a sink may
+    // sample each shape once and reuse it; `origin` places this copy.
+    virtual void curve(const std::string& id, Vec origin, bool closed, const CurveSampler& sample) = 0;
+    // A filled black arrowhead triangle.
+    virtual void arrowhead(Vec tip, Vec base1, Vec base2) = 0;
+    // A vertex circle with an optional centred label.
+    virtual void vertex(Vec centre, double radius, const std::string& fill, const std::string& label,
+                        const std::string& label_colour) = 0;
+};
+
+// Lay out diagram G (vertices along the electron line, phonons as wavy arcs)
+// and feed the resulting primitives to `sink`.
+void draw_diagram(const SimpleGraph& G, DiagramSink& sink);
+
+#endif
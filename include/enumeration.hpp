@@ -0,0 +1,183 @@
+#ifndef ENUMERATION_HPP
+#define ENUMERATION_HPP
+
+#include "graph.hpp"
+#include "filter.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using EdgeList = std::vector<std::pair<int, int>>;
+
+// Everything that decides which diagrams a run produces.
+struct EnumerationOptions {
+    int order = 0;
+    bool include_improper = false;
+    // flag for ignoring diagrams with fermion-loop
+    bool ignore_fermion_loop = true;
+    // Keep only skeleton diagrams (proper, with no self-energy insertion).
+    bool skeleton_only = false;
+    DiagramFilter filter;
+};
+
+// A string that is equal for two option sets exactly when they select the
+// same diagrams, for keying cached catalogues.
+std::string catalogue_key(const EnumerationOptions& options);
+
+// Every vertex pair (i <= j) on n vertices, in lexicographic order. Combinations
+// drawn from it in enumeration order are therefore sorted edge lists, and they
+// are visited in lexicographic order of those lists.
+EdgeList all_vertex_pairs(int number_of_vertices);
+
+// Edge sets of one size on n vertices, in enumeration order, packed into one
+// flat buffer: row i is `width` consecutive indices into all_vertex_pairs(n).
+class CandidateRows {
+public:
+    CandidateRows(int number_of_vertices, int width);
+    std::size_t size() const { return size_; }
+    void push_back(const std::vector<int>& pair_indices);
+    // Row i as a sorted edge list, written into `edges` (reusing its storage).
+    void decode(std::size_t i, EdgeList& edges) const;
+    EdgeList operator[](std::size_t i) const;
+    // The number of the row equal to the sorted edge list, or -1.
+    long long find(const EdgeList& edges) const;
+
+private:
+    int number_of_vertices_;
+    int width_;
+    EdgeList pairs_;
+    std::size_t size_ = 0;
+    std::vector<std::uint16_t> indices_;
+};
+
+// Phonon (dashed) and electron (solid) edge sets that can still produce a valid
+// diagram on n vertices, in enumeration order. Every candidate of a run is a
+// pair (dashed row, solid row) of these, scanned dashed-major.
+CandidateRows dashed_candidates(const EnumerationOptions& options, int number_of_vertices);
+CandidateRows solid_candidates(const EnumerationOptions& options, int number_of_vertices);
+
+// The candidate pairs on n vertices as a hash join of the two row lists.
+// Whether a pair survives the shape and connectivity tests of build_diagram
+// is decided by the two sides separately: the shape test reads only electron
+// degrees and electron loops, and the diagram is connected exactly when the
+// phonon lines join up the electron components. Solid rows of valid shape
+// are therefore bucketed by their partition of the vertices into electron
+// components. Whether a phonon row connects a bucket depends only on the
+// row's own component partition, so the compatible buckets are computed once
+// per distinct phonon partition, together with the ordered list of partner
+// rows as runs of consecutive shaped rows. A phonon row looks its partners up
+// by that key, in time linear in the rows returned.
+class CandidateJoin {
+public:
+    CandidateJoin(const EnumerationOptions& options, int number_of_vertices);
+    const CandidateRows& dashed() const { return dashed_; }
+    const CandidateRows& solid() const { return solid_; }
+    // The solid rows that can complete `dashed_edges`, in row order, so the
+    // joined pairs are scanned in the same order as the nested loop.
+    void partners(const EdgeList& dashed_edges, std::vector<std::size_t>& solid_rows) const;
+
+private:
+    struct Bucket {
+        std::vector<int> component; // electron component of each vertex
+        int components = 0;
+    };
+    // Half-open range of positions in shaped_rows_.
+    using Run = std::pair<std::size_t, std::size_t>;
+    // The positions of the shaped rows whose components `dashed_edges` join
+    // into one, as maximal runs in row order.
+    void compatible_runs(const EdgeList& dashed_edges, std::vector<Run>& runs) const;
+
+    int number_of_vertices_;
+    CandidateRows dashed_;
+    CandidateRows solid_;
+    std::vector<Bucket> buckets_;
+    std::vector<std::size_t> shaped_rows_; // solid rows of valid shape, in row order
+    std::vector<int> shaped_buckets_;      // and the bucket of each
+    // Phonon component partition -> its partners, as runs of shaped_rows_.
+    std::unordered_map<std::string, std::vector<Run>> probe_;
+};
+
+// Candidate pairs of a scan: `pairs` in the full dashed x solid product and
+// `joined` handed out by CandidateJoin; the difference never reaches
+// build_diagram.
+struct ScanStats {
+    long long pairs = 0;
+    long long joined = 0;
+};
+
+// Build the candidate diagram for one (dashed, solid) pair and run every
+// acceptance test of a run on it. On success G is classified, coloured and
+// labelled with the phonon-line count of each vertex.
+bool build_diagram(const EnumerationOptions& options, int number_of_vertices,
+                   const EdgeList& dashed_edges, const EdgeList& solid_edges,
+                   SimpleGraph& G, std::vector<SimpleGraph::vertex_descriptor>& vertices);
+
+// The canonical form of an emitted diagram (see canonical_form), computed on
+// first use: a scan only canonicalizes a diagram once a later candidate lands
+// in its invariant bucket, so visitors that never ask do not pay for it.
+class CanonicalKey {
+public:
+    explicit CanonicalKey(std::string key) : key_(std::move(key)), computed_(true) {}
+    CanonicalKey(const SimpleGraph& G, const ColourRefinement& refinement) : graph_(&G), refinement_(&refinement) {}
+    const std::string& str() const {
+        if (!computed_) {
+            key_ = canonical_form(*graph_, *refinement_);
+            computed_ = true;
+        }
+        return key_;
+    }
+    bool computed() const { return computed_; }
+private:
+    const SimpleGraph* graph_ = nullptr;
+    const ColourRefinement* refinement_ = nullptr;
+    mutable std::string key_;
+    mutable bool computed_ = false;
+};
+
+// Called once per distinct diagram, in id order, with its canonical key.
+using DiagramVisitor = std::function<void(const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>& vertices,
+                                          const CanonicalKey& canonical_key)>;
+
+// Two-level duplicate filter for a stream of accepted candidates. Candidates
+// are bucketed by the invariant of refine_colours; one whose bucket is still
+// empty cannot be a duplicate and is emitted without a canonical labelling.
+// The labelling runs only when a bucket already holds a diagram, and then
+// also for the bucket's first occupant if its key was never asked for.
+class DiagramDeduplicator {
+public:
+    // If G is isomorphic to no diagram inserted before, call `emit` with its
+    // key and return true; otherwise return false.
+    bool insert(const SimpleGraph& G, const std::function<void(const CanonicalKey&)>& emit);
+    bool insert(const SimpleGraph& G) { return insert(G, [](const CanonicalKey&) {}); }
+    // Number of distinct diagrams inserted.
+    long long size() const { return size_; }
+private:
+    // A bucket's first occupant, kept as its bare lines until its key is
+    // needed; null once the bucket's keys are all in keys_.
+    struct Pending {
+        DiagramLines lines;
+        ColourRefinement refinement;
+    };
+    std::unordered_map<std::size_t, std::unique_ptr<Pending>> buckets_;
+    std::unordered_set<std::string> keys_;
+    long long size_ = 0;
+};
+
+// Scan every candidate in order, keep the accepted ones and drop isomorphic
+// repeats. Returns the number of diagrams visited; the candidate pairs are
+// added to `stats` if given.
+long long scan_diagrams(const EnumerationOptions& options, const DiagramVisitor& visit, ScanStats* stats = nullptr);
+
+// A full run. Proper runs are a scan; improper runs compose the proper
+// catalogues of orders 1..n instead (see composition.hpp), with the same ids.
+long long enumerate_diagrams(const EnumerationOptions& options, const DiagramVisitor& visit);
+
+// Every diagram of a run, in id order.
+std::shared_ptr<const std::vector<SimpleGraph>> enumerate_catalogue(const EnumerationOptions& options);
+
+#endif
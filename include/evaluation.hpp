@@ -0,0 +1,77 @@
+#ifndef EVALUATION_HPP
+#define EVALUATION_HPP
+
+#include "graph.hpp"
+#include <array>
+#include <complex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Numerical evaluation of self-energy diagrams for the Holstein model
+// (electrons coupled locally, with strength g, to Einstein phonons of
+// frequency omega0) on the fermionic Matsubara grid omega_n = (2n + 1) pi / beta.
+//
+// Electron lines are local propagators, so the band enters only through its
+// density of states, given as weighted levels:
+//   G0(i omega) = sum_k w_k / (i omega - (e_k - mu)),
+//   D0(i nu)    = -2 omega0 / (nu^2 + omega0^2).
+// Each diagram contributes
+//   Sigma(i omega_n) = (-1)^F T^n sum_{internal} prod (-g^2 D0) prod G0,
+// with n phonon lines, F closed fermion loops and one Matsubara sum per
+// independent internal frequency, frequency being conserved at every vertex.
+// A vertex carrying several phonon lines is evaluated with the same rules (a
+// multi-phonon vertex); "--filter maxphonon=1" keeps the linear-coupling set.
+struct HolsteinModel {
+    double beta = 10.0;
+    double chemical_potential = 0.0;
+    double coupling = 0.1;        // g
+    double phonon_frequency = 1.0; // omega0
+    std::vector<std::pair<double, double>> levels; // (energy, weight); empty: one level at 0
+    int cutoff = 32;      // internal sums run over |frequency| <= 2 pi T cutoff
+    int frequencies = 16; // external omega_n for n = 0..frequencies-1
+};
+
+// Parse a comma-separated model expression, e.g.
+//   "beta=10,g=0.5,omega0=1,mu=0,level=-1:0.5,level=1:0.5,cutoff=64,frequencies=32"
+// Terms: beta=, mu=, g=, omega0=, level=E:W (repeatable), chain=t:N (levels
+// -2t cos(2 pi k / N) of a tight-binding chain with N sites), cutoff=,
+// frequencies=. Returns false and sets `error` on bad input.
+bool parse_model(const std::string& expression, HolsteinModel& model, std::string& error);
+
+// Most independent internal frequencies a compiled diagram may have (one per
+// phonon line, so the highest order the generator produces).
+constexpr int max_internal_frequencies = 4;
+
+// One propagator of a compiled diagram. Its Matsubara frequency, in units of
+// pi T, is `external` (2n + 1) + sum_j internal[j] k_j, where k_j = 2m + 1 for
+// a fermionic and 2m for a bosonic internal frequency with index m.
+struct Propagator {
+    bool phonon;
+    int external;
+    std::array<int, max_internal_frequencies> internal;
+};
+
+// A diagram as a flat instruction list: the product of `propagators`, summed
+// over `fermionic.size()` internal frequencies, times `sign` (-1 per loop).
+struct CompiledDiagram {
+    int order = 0;
+    double sign = 1.0;
+    std::vector<bool> fermionic; // per internal frequency
+    std::vector<Propagator> propagators;
+};
+
+// Assign conserved frequencies to the lines of a classified diagram (as a run
+// emits it): one bosonic frequency per phonon line, one fermionic frequency
+// per closed fermion loop, minus one phonon frequency per loop fixed by
+// conservation. False if it needs more than max_internal_frequencies.
+bool compile_diagram(const SimpleGraph& G, CompiledDiagram& compiled);
+
+// Sigma(i omega_n), n = 0..model.frequencies-1, for every diagram. Work is
+// split by (diagram, outermost internal index) over `threads` threads (0: one
+// per hardware thread); each inner step multiplies the propagators across the
+// whole external grid in contiguous batches.
+std::vector<std::vector<std::complex<double>>> evaluate_diagrams(const std::vector<CompiledDiagram>& diagrams,
+                                                                 const HolsteinModel& model, int threads = 0);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef FILTER_HPP
+#define FILTER_HPP
+
+#include "graph.hpp"
+#include <climits>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Phonon topology relative to the electron backbone. Each phonon line spans an
+// interval of backbone positions; two lines cross when their intervals
+// interleave, and are nested when one interval contains the other. Tadpoles
+// (phonon self-loops) span no interval and are ignored.
+enum class PhononTopology {
+    Any,
+    Rainbow, // every pair of phonon lines is nested
+    Ladder,  // no pair is nested or crossed (lines sit side by side)
+    Crossed  // at least one pair of phonon lines crosses
+};
+
+// A conjunction of predicates parsed from the --filter expression. Each is
+// applied at the earliest enumeration stage that can decide it: the vertex
+// count skips whole candidate spaces, degree-only predicates prune partial
+// phonon combinations, and the topology test runs before canonical_form.
+struct DiagramFilter {
+    int min_vertices = 1;
+    int max_vertices = INT_MAX;
+    bool no_tadpoles = false;
+    int max_phonons_per_vertex = INT_MAX;
+    PhononTopology topology = PhononTopology::Any;
+
+    bool accepts_vertex_count(int number_of_vertices) const {
+        return number_of_vertices >= min_vertices && number_of_vertices <= max_vertices;
+    }
+    // True while a partial phonon-edge set can still pass after adding the
+    // line (a, b), given the phonon degrees of a and b including it; every
+    // degree-only predicate stays false once it has failed.
+    bool accepts_dashed_line(int a, int b, int degree_a, int degree_b) const {
+        return !(no_tadpoles && a == b) && degree_a <= max_phonons_per_vertex && degree_b <= max_phonons_per_vertex;
+    }
+    // Topology test on a classified diagram (initial/final vertices known).
+    bool accepts_topology(const SimpleGraph& G) const;
+};
+
+// Parse a comma-separated filter expression, e.g.
+//   "vertices<=3,notadpole,maxphonon=2,rainbow"
+// Terms: vertices=N, vertices<=N, vertices>=N, notadpole, maxphonon=K,
+// rainbow, ladder, crossed. Returns false and sets `error` on bad input.
+bool parse_filter(const std::string& expression, DiagramFilter& filter, std::string& error);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef GALLERY_WRITER_HPP
+#define GALLERY_WRITER_HPP
+
+#include "svg_writer.hpp"
+#include <string>
+#include <vector>
+
+// Every diagram of a run in one self-contained HTML page that stays usable at
+// thousands of diagrams. The drawings are stored once, as a single text blob
+// of SVG bodies sharing one symbol table (see SvgSymbolTable), and a metadata
+// table gives each diagram's offset and length in the blob, its size, vertex
+// count and phonon degrees. The page builds SVG nodes only for the grid rows
+// in view (plus a small margin), and drops them again once scrolled away.
+// It filters client-side by vertex count, the largest phonon degree of a
+// vertex and the sorted phonon-degree sequence.
+class GalleryWriter {
+public:
+    void add(const SimpleGraph& G, long long id);
+    void write(const std::string& path, const std::string& title) const;
+private:
+    struct Entry {
+        long long id;
+        std::size_t offset, length;
+        double width, height;
+        int number_of_vertices;
+        std::string degrees; // phonon degree per vertex, descending ("3,2,1")
+    };
+    SvgSymbolTable symbols_;
+    std::string blob_;
+    std::vector<Entry> entries_;
+};
+
+#endif
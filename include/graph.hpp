@@ -2,7 +2,7 @@
 #define GRAPH_HPP
 
 #include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/graphviz.hpp>
+#include <array>
 #include <string>
 #include <vector>
 #include <tuple>
@@ -34,43 +34,7 @@ struct EdgeProperties {
 
 typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::undirectedS, VertexProperties, EdgeProperties> SimpleGraph;
 
-// Custom vertex property writer
-class vertex_writer {
-public:
-    vertex_writer(const SimpleGraph &g) : g_(g) {}
-
-    template <class Vertex>
-    void operator()(std::ostream &out, const Vertex &v) const {
-        out << "[label=\"" << g_[v].label << "\", pos=\"" << g_[v].x << "," << g_[v].y << "!\", width=\"" << g_[v].size << "\", height=\"" << g_[v].size << "\", fillcolor=\"" << g_[v].fillcolor << "\", style=filled]";
-    }
-private:
-    const SimpleGraph &g_;
-};
-
-// Custom edge property writer
-class edge_writer {
-public:
-    edge_writer(const SimpleGraph &g) : g_(g) {}
-
-    template <class Edge>
-    void operator()(std::ostream &out, const Edge &e) const {
-        out << "[style=\"" << to_dot_style(g_[e].style) << "\"]";
-    }
-private:
-    const SimpleGraph &g_;
-};
-
-// Custom graph property writer
-class graph_writer {
-public:
-    void operator()(std::ostream &out) const {
-        out << "layout=neato;" << std::endl;
-    }
-};
-
 std::tuple<SimpleGraph, std::vector<SimpleGraph::vertex_descriptor>> get_initial_graph_and_vertices(int number_of_vertices);
-void align_vertices(SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>& vertices, double x_length, double y_length);
-void add_short_slanted_lines(SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>& vertices);
 
 // Add a set of edges of one style (dashed = phonon, solid = electron) to G,
 // updating the per-vertex degree counters and the fermion-loop flag.
@@ -78,10 +42,36 @@ void add_styled_edges(SimpleGraph& G, const std::vector<SimpleGraph::vertex_desc
                       const std::vector<std::pair<int, int>>& edges, bool dashed);
 // True if every vertex is reachable from vertices[0] over all edges.
 bool is_fully_connected(const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>& vertices);
+// The stable 1-WL colouring of G's vertices by (electron, phonon) degree and
+// coloured neighbourhoods, the cheap first stage of canonical_form. Colours
+// are ranks of isomorphism-invariant signatures, and `invariant` hashes the
+// vertex count, degrees and stable signatures: isomorphic diagrams always get
+// the same invariant, and diagrams with different invariants are never
+// isomorphic.
+struct ColourRefinement {
+    std::vector<int> colour;
+    std::size_t invariant = 0;
+};
+ColourRefinement refine_colours(const SimpleGraph& G);
 // A canonical string for the edge-coloured (electron/phonon) multigraph: two
 // diagrams are isomorphic if and only if their canonical forms are equal. This
 // lets deduplication use a hash set instead of pairwise isomorphism tests.
 std::string canonical_form(const SimpleGraph& G);
+// The same, reusing the colouring refine_colours(G) already computed. If
+// `automorphisms` is given it receives the number of vertex permutations that
+// map G onto itself (lines with their styles and multiplicities).
+std::string canonical_form(const SimpleGraph& G, const ColourRefinement& refinement,
+                           long long* automorphisms = nullptr);
+// The edge-coloured multigraph that canonical_form reads, without the vertex
+// and drawing properties of a SimpleGraph: every line as (endpoint, endpoint,
+// style), style 0 = solid, 1 = dashed.
+struct DiagramLines {
+    int vertices = 0;
+    std::vector<std::array<int, 3>> lines;
+};
+DiagramLines diagram_lines(const SimpleGraph& G);
+std::string canonical_form(const DiagramLines& diagram, const ColourRefinement& refinement,
+                           long long* automorphisms = nullptr);
 // Classify vertices (initial/final/intermediate) by their solid degree, colour
 // them, and decide whether the graph is a valid self-energy diagram. Mutates G.
 bool classify_and_validate_shape(SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>& vertices,
@@ -91,5 +81,9 @@ bool classify_and_validate_shape(SimpleGraph& G, const std::vector<SimpleGraph::
 // connected. Improper (reducible) diagrams are resummed by the Dyson equation and
 // so are normally excluded from the self-energy.
 bool is_proper_diagram(const SimpleGraph& G);
+// True if a proper diagram is a skeleton: no internal electron line carries a
+// self-energy insertion, i.e. no two electron lines cut off a part of the
+// diagram that holds neither external vertex.
+bool is_skeleton_diagram(const SimpleGraph& G);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,13 @@
+#ifndef PNG_WRITER_HPP
+#define PNG_WRITER_HPP
+
+#include "graph.hpp"
+#include <string>
+
+// Render the diagram G straight to a PNG file, in-process: the layout of
+// write_svg is rasterized with anti-aliasing (lines, wavy polylines, circles,
+// arrowheads and digit labels) and encoded without external libraries, so no
+// Graphviz process is spawned per diagram.
+void write_png(const SimpleGraph& G, const std::string& path);
+
+#endif
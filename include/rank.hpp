@@ -0,0 +1,53 @@
+#ifndef RANK_HPP
+#define RANK_HPP
+
+#include "enumeration.hpp"
+#include <string>
+#include <vector>
+
+// Random access to the deterministic diagram order of a run.
+//
+// A run numbers each diagram at the first candidate (dashed row, solid row)
+// that produces it. Candidate edge lists are sorted and scanned in
+// lexicographic order, so that first candidate is the labelling whose phonon
+// edge list is lexicographically smallest over all vertex relabellings and,
+// among those, whose electron edge list is smallest under the automorphisms of
+// the phonon edges. Only phonon rows that are already minimal can therefore
+// introduce diagrams, and whether a candidate is new is a local test instead of
+// a lookup in the history of the run.
+//
+// The index stores how many diagrams each phonon row introduces; prefix sums
+// over it locate the row holding id k, and only that row is re-enumerated.
+class DiagramIndex {
+public:
+    // Load the row counts for `options` from `path`, or build them with one full
+    // enumeration and save them there. `filter_expression` is the text the
+    // filter was parsed from; a cached index is reused only if it matches.
+    static DiagramIndex load_or_build(const EnumerationOptions& options, const std::string& filter_expression,
+                                      const std::string& path);
+
+    long long size() const { return total_; }
+    // Diagram number k, classified and labelled as in a full run (false if k is
+    // out of range).
+    bool unrank(long long k, SimpleGraph& G, std::vector<SimpleGraph::vertex_descriptor>& vertices) const;
+    // Id of diagram G under any vertex labelling, or -1 if the run excludes it.
+    long long rank(const SimpleGraph& G) const;
+
+private:
+    struct Row {
+        int number_of_vertices;
+        int row;            // index into dashed_candidates(options, number_of_vertices)
+        long long first_id; // id of the first diagram the row introduces
+        long long count;
+    };
+    EnumerationOptions options_;
+    std::vector<Row> rows_; // rows introducing at least one diagram, in id order
+    long long total_ = 0;
+};
+
+// The labelling under which a run first meets diagram G: its phonon edge list
+// is lexicographically smallest over all vertex relabellings and, among
+// those, its electron edge list is smallest. Both lists come back sorted.
+void first_labelling(const SimpleGraph& G, EdgeList& dashed, EdgeList& solid);
+
+#endif
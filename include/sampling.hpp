@@ -0,0 +1,64 @@
+#ifndef SAMPLING_HPP
+#define SAMPLING_HPP
+
+#include "enumeration.hpp"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Uniform random diagrams of a run, for orders full enumeration cannot reach.
+//
+// A labelled diagram on V vertices is a pair of line multisets on the
+// vertices 0..V-1, electron and phonon, that build_diagram accepts. The shape
+// test fixes the electron lines: one open path through at least two vertices
+// plus closed loops, or one vertex without electron lines plus closed loops
+// (electron tadpoles only if the run keeps fermion loops). Every vertex
+// carries a phonon line. The sampler counts both kinds of line sets exactly:
+//   - electron sets by the exponential formula for loops;
+//   - covering phonon multisets by removing the first uncovered vertex with
+//     all its lines, so the count depends only on how many vertices are still
+//     uncovered, how many are covered, and how many lines are left.
+// It draws a vertex count with weight (electron sets) x (phonon sets), then
+// a uniform pair on it, and redraws until build_diagram accepts. The accepted
+// diagrams are then uniform over the labelled diagrams of the run. The tables
+// have O(order^3) entries, and a draw needs O(order^2) work besides
+// build_diagram.
+//
+// A class with V vertices and |Aut| automorphisms has V! / |Aut| labellings,
+// so it is drawn with probability proportional to V! / |Aut|. Weighting each
+// sample by |Aut| / V! (see canonical_form) makes estimates uniform over
+// classes.
+class DiagramSampler {
+public:
+    DiagramSampler(const EnumerationOptions& options, std::uint64_t seed);
+
+    // Draw the next diagram, classified and labelled as in a run. False if
+    // the run has no candidates, or none was accepted in `max_attempts` draws.
+    bool next(SimpleGraph& G, std::vector<SimpleGraph::vertex_descriptor>& vertices,
+              long long max_attempts = 1000000);
+    // Candidates drawn so far and how many of them were accepted.
+    long long attempts() const { return attempts_; }
+    long long accepted() const { return accepted_; }
+
+private:
+    // Phonon multisets of `lines` lines on `uncovered` + `covered` vertices
+    // that give each of the uncovered ones a line.
+    long double covering(int uncovered, int covered, int lines) const;
+    void draw_electron_lines(int number_of_vertices, EdgeList& edges);
+    void draw_phonon_lines(int number_of_vertices, EdgeList& edges);
+    // A random index, each with probability weights[i] / sum(weights).
+    std::size_t pick(const std::vector<long double>& weights);
+    // A uniform integer in [0, n).
+    std::uint64_t below(std::uint64_t n);
+
+    EnumerationOptions options_;
+    std::mt19937_64 random_;
+    std::vector<long double> loops_;          // electron loops through c given vertices
+    std::vector<long double> loop_sets_;      // sets of loops covering m given vertices
+    std::vector<long double> covering_;       // covering(u, w, k), u + w <= 2 * order
+    std::vector<long double> vertex_weights_; // candidate pairs on V vertices
+    long long attempts_ = 0;
+    long long accepted_ = 0;
+};
+
+#endif
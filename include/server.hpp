@@ -0,0 +1,33 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <iosfwd>
+#include <string>
+
+// Long-running local server. Requests and responses are JSON objects, one per
+// line, read from stdin (responses on stdout) or from clients of a Unix
+// domain socket. Socket requests are answered by a thread pool, one request
+// line per task, each client's responses in request order.
+// Enumerated catalogues (diagrams plus a canonical-key -> id table) are built
+// on first use for each (order, improper, filter) and kept for later requests;
+// improper catalogues are composed from the cached proper ones.
+//
+// Requests ("order" 1-4; "improper", "skeleton" and "filter" are optional everywhere,
+// and a "tag" field is echoed back):
+//   {"op": "count", "order": 3}                       -> "count", per-vertex breakdown
+//   {"op": "diagram", "order": 3, "id": 5, "format": "svg" | "dot"}
+//                                                     -> "key" and the rendered "payload"
+//   {"op": "lookup", "order": 3, "key": "<canonical form>"}  -> "id"
+//   {"op": "stats"}   -> request counts and cold (catalogue built) / warm latency
+//   {"op": "shutdown"}
+struct ServerOptions {
+    std::string socket_path; // empty: serve stdin/stdout
+    int threads = 0;         // 0: one per hardware thread
+};
+
+int run_server(const ServerOptions& options);
+
+// The stdin mode of run_server on arbitrary streams, with a fresh cache.
+int serve_stream(std::istream& in, std::ostream& out);
+
+#endif
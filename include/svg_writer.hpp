@@ -2,11 +2,50 @@
 #define SVG_WRITER_HPP
 
 #include "graph.hpp"
+#include <map>
 #include <string>
+#include <vector>
+
+// Shared wavy-line geometry for compact SVG output. Every distinct phonon (or
+// bowed electron) shape is identified by its kind, span and stack level, so it
+// is sampled once, stored in <defs> in local coordinates and drawn everywhere
+// else by a <use> translated onto its first vertex.
+class SvgSymbolTable {
+public:
+    bool contains(const std::string& id) const { return paths_.count(id) != 0; }
+    void add(const std::string& id, std::string path_data) { paths_.emplace(id, std::move(path_data)); }
+    bool empty() const { return paths_.empty(); }
+    // The <defs> block holding every registered shape (empty if there is none).
+    std::string defs() const;
+private:
+    std::map<std::string, std::string> paths_;
+};
 
 // Render the diagram G to a standalone SVG file (no external tool needed).
 // Electron lines are drawn solid with a flow arrow; phonon lines are drawn as
 // wavy lines; vertices are coloured circles (red = initial, blue = final).
-void write_svg(const SimpleGraph& G, const std::string& path);
+// With `compact`, repeated wavy lines are emitted once as shared definitions.
+void write_svg(const SimpleGraph& G, const std::string& path, bool compact = false);
+// The same document as a string.
+std::string render_svg(const SimpleGraph& G, bool compact = false);
+
+// The drawing of G without the enclosing <svg> element (background
+// included), its wavy lines registered in `symbols` and drawn by reference.
+// Sets the canvas size in `width` and `height`.
+std::string render_svg_body(const SimpleGraph& G, SvgSymbolTable& symbols, double& width, double& height);
+
+// A contact sheet: every diagram of a run laid out on a grid in a single SVG,
+// all sharing one symbol table so each distinct wavy line is written once.
+class SvgSheetWriter {
+public:
+    explicit SvgSheetWriter(int columns = 8) : columns_(columns) {}
+    void add(const SimpleGraph& G);
+    void write(const std::string& path) const;
+private:
+    struct Cell { std::string body; double width, height; };
+    int columns_;
+    SvgSymbolTable symbols_;
+    std::vector<Cell> cells_;
+};
 
 #endif
@@ -4,31 +4,35 @@
 #include <vector>
 #include <cmath>
 
-namespace detail {
-template <typename T, typename F>
-void enumerate_combinations_rec(const std::vector<T>& elements, int k, int start,
-                                std::vector<T>& current, F& visit) {
-    if (static_cast<int>(current.size()) == k) {
-        visit(current);
-        return;
+// Walk every size-k combination with repetition of the indices 0..n-1 in
+// lexicographic (non-decreasing) order, iteratively and one index at a time.
+// `state` follows the walk: state.push(i) appends index i to the current
+// prefix and returns false if no combination extending it can be kept, which
+// skips that whole subtree; state.pop(i) undoes the matching push, whatever
+// it returned. `visit` is called with the indices of every complete
+// combination whose pushes all succeeded.
+template <typename S, typename F>
+void enumerate_combinations(int n, int k, S& state, F visit) {
+    std::vector<int> current(k > 0 ? k : 0);
+    int depth = 0, next = 0;
+    while (true) {
+        if (depth == k) {
+            visit(static_cast<const std::vector<int>&>(current));
+        } else if (next < n) {
+            current[depth] = next;
+            if (state.push(next)) {
+                ++depth; // the same index may repeat, so `next` stays
+            } else {
+                state.pop(next);
+                ++next;
+            }
+            continue;
+        }
+        if (depth == 0) return;
+        --depth;
+        state.pop(current[depth]);
+        next = current[depth] + 1;
     }
-    for (int i = start; i < static_cast<int>(elements.size()); ++i) {
-        current.push_back(elements[i]);
-        enumerate_combinations_rec(elements, k, i, current, visit);
-        current.pop_back();
-    }
-}
-}
-
-// Stream every size-k combination with repetition of `elements`, in the same
-// lexicographic (non-decreasing index) order as a fully materialized list, but
-// without building that list. `visit` is called with each combination in turn,
-// letting the caller filter on the fly instead of allocating all of them.
-template <typename T, typename F>
-void enumerate_combinations(const std::vector<T>& elements, int k, F visit) {
-    std::vector<T> current;
-    if (k > 0) current.reserve(k);
-    detail::enumerate_combinations_rec(elements, k, 0, current, visit);
 }
 
 struct Point {
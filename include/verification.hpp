@@ -0,0 +1,55 @@
+#ifndef VERIFICATION_HPP
+#define VERIFICATION_HPP
+
+#include "enumeration.hpp"
+#include <string>
+#include <vector>
+
+// Differential verification of a run against slow reference implementations.
+//
+// The reference scans every (phonon, electron) edge-multiset pair in
+// lexicographic order with only the two row conditions that the shape test
+// implies (a phonon line on every vertex, electron degree <= 2). It tests
+// connectivity, bridges and self-energy insertions by removing edges from a
+// fresh graph and counting connected components, and applies the filter to
+// the finished diagram. It groups candidates into isomorphism classes with
+// boost::isomorphism on the edge-subdivided graph, which is a simple graph
+// that keeps line styles, multiple lines and loops. The optimized run is
+// checked against it:
+//   bridge    - is_proper_diagram on every candidate of valid shape
+//   skeleton  - is_skeleton_diagram on every proper candidate
+//   canonical - equal canonical_form <=> isomorphic, on every accepted
+//               candidate and on every pair of emitted diagrams
+//   pruning   - no accepted candidate uses a row dashed_candidates or
+//               solid_candidates dropped, or a pair CandidateJoin skips
+//   count     - enumerate_diagrams emits one diagram per class, and
+//   order     - in first-occurrence order, i.e. with the brute-force ids.
+// The last two need the whole candidate stream, so they are skipped when only
+// a sample of it is scanned.
+
+// One cross-check. For failed checks, `smallest` is the offending diagram
+// with the fewest vertices and lines, and `message` says what went wrong.
+struct VerificationCheck {
+    std::string name;
+    long long compared = 0;
+    long long mismatches = 0;
+    std::string message;
+    SimpleGraph smallest;
+};
+
+struct VerificationReport {
+    std::vector<VerificationCheck> checks;
+    bool passed() const;
+    // One "<name>: <compared> compared, <mismatches> mismatches" line per
+    // check, followed by the message of each failed one.
+    std::string summary() const;
+    // Write the smallest offending diagram of each failed check as
+    // <directory>/verify_<name>.dot.
+    void write_mismatches(const std::string& directory) const;
+};
+
+// Cross-check the run `options` against the references. With sample_every
+// = k > 1 only every k-th phonon row of each vertex count is scanned.
+VerificationReport verify_run(const EnumerationOptions& options, int sample_every = 1);
+
+#endif
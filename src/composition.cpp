@@ -0,0 +1,265 @@
+#include "composition.hpp"
+#include "rank.hpp"
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+
+namespace {
+// A diagram as raw edge lists, with the ways it can be threaded into a chain
+// or onto a line: (entry, exit) external vertices, both orders unless they
+// coincide.
+struct Piece {
+    int number_of_vertices;
+    EdgeList dashed, solid;
+    std::vector<std::pair<int, int>> orientations;
+};
+
+void sorted_edges(const SimpleGraph& G, EdgeList& dashed, EdgeList& solid) {
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        int a = static_cast<int>(source(*er.first, G)), b = static_cast<int>(target(*er.first, G));
+        (G[*er.first].style == LineStyle::Dashed ? dashed : solid).push_back({std::min(a, b), std::max(a, b)});
+    }
+    std::sort(dashed.begin(), dashed.end());
+    std::sort(solid.begin(), solid.end());
+}
+
+Piece make_piece(const SimpleGraph& G) {
+    Piece p;
+    p.number_of_vertices = static_cast<int>(num_vertices(G));
+    sorted_edges(G, p.dashed, p.solid);
+    int initial = -1, final = -1;
+    for (int v = 0; v < p.number_of_vertices; ++v) {
+        if (G[v].initial) initial = v;
+        if (G[v].final) final = v;
+    }
+    p.orientations.push_back({initial, final});
+    if (initial != final) p.orientations.push_back({final, initial});
+    return p;
+}
+
+// One diagram of the improper run, keyed by its first labelling.
+struct Entry {
+    int number_of_vertices;
+    EdgeList dashed, solid;
+    const SimpleGraph* proper; // the catalogue graph, or null for a chain
+};
+
+bool entry_less(const Entry& a, const Entry& b) {
+    return std::tie(a.number_of_vertices, a.dashed, a.solid) < std::tie(b.number_of_vertices, b.dashed, b.solid);
+}
+
+// Depth-first over chains: append each piece of each order that still fits in
+// `remaining`, in each orientation, bridged to the previous exit vertex.
+class ChainBuilder {
+public:
+    ChainBuilder(const EnumerationOptions& options, const std::vector<std::vector<Piece>>& pieces,
+                 std::vector<Entry>& entries)
+        : options_(options), pieces_(pieces), entries_(entries) {}
+
+    void extend(int remaining, int length, int number_of_vertices, int exit) {
+        if (number_of_vertices > options_.filter.max_vertices) return;
+        if (remaining == 0) {
+            if (length >= 2) finish(number_of_vertices);
+            return;
+        }
+        // A single piece of the full order is a proper diagram, not a chain.
+        const int largest = length == 0 ? remaining - 1 : remaining;
+        for (int order = 1; order <= largest; ++order) {
+            for (const Piece& piece : pieces_[order]) {
+                for (const auto& ends : piece.orientations) {
+                    const std::size_t dashed_size = dashed_.size(), solid_size = solid_.size();
+                    for (const auto& e : piece.dashed) {
+                        dashed_.push_back({e.first + number_of_vertices, e.second + number_of_vertices});
+                    }
+                    for (const auto& e : piece.solid) {
+                        solid_.push_back({e.first + number_of_vertices, e.second + number_of_vertices});
+                    }
+                    if (exit >= 0) solid_.push_back({exit, ends.first + number_of_vertices});
+                    extend(remaining - order, length + 1, number_of_vertices + piece.number_of_vertices,
+                           ends.second + number_of_vertices);
+                    dashed_.resize(dashed_size);
+                    solid_.resize(solid_size);
+                }
+            }
+        }
+    }
+
+private:
+    void finish(int number_of_vertices) {
+        if (!options_.filter.accepts_vertex_count(number_of_vertices)) return;
+        EdgeList dashed = dashed_, solid = solid_;
+        std::sort(dashed.begin(), dashed.end());
+        std::sort(solid.begin(), solid.end());
+        SimpleGraph G;
+        std::vector<SimpleGraph::vertex_descriptor> vertices;
+        if (!build_diagram(options_, number_of_vertices, dashed, solid, G, vertices) || !seen_.insert(G)) return;
+        Entry entry{number_of_vertices, {}, {}, nullptr};
+        first_labelling(G, entry.dashed, entry.solid);
+        entries_.push_back(std::move(entry));
+    }
+
+    const EnumerationOptions& options_;
+    const std::vector<std::vector<Piece>>& pieces_;
+    std::vector<Entry>& entries_;
+    EdgeList dashed_, solid_;
+    DiagramDeduplicator seen_;
+};
+
+// Depth-first over insertions into one skeleton: each electron line stays
+// bare or carries a self-energy of some order, in either orientation, until
+// the orders add up.
+class InsertionBuilder {
+public:
+    InsertionBuilder(const EnumerationOptions& options, const std::vector<std::vector<Piece>>& pieces,
+                     DiagramDeduplicator& seen)
+        : options_(options), pieces_(pieces), seen_(seen) {}
+
+    void insert_into(const Piece& skeleton, int remaining) {
+        host_ = &skeleton;
+        lines_.resize(skeleton.solid.size());
+        std::iota(lines_.begin(), lines_.end(), 0);
+        choices_.assign(lines_.size(), {nullptr, {0, 0}});
+        place(0, remaining, skeleton.number_of_vertices);
+    }
+
+private:
+    struct Choice {
+        const Piece* piece; // null: the line stays bare
+        std::pair<int, int> ends;
+    };
+
+    void place(std::size_t line, int remaining, int number_of_vertices) {
+        if (number_of_vertices > options_.filter.max_vertices) return;
+        if (line == lines_.size()) {
+            if (remaining == 0) finish(number_of_vertices);
+            return;
+        }
+        place(line + 1, remaining, number_of_vertices);
+        for (int order = 1; order <= remaining; ++order) {
+            for (const Piece& piece : pieces_[order]) {
+                for (const auto& ends : piece.orientations) {
+                    choices_[line] = {&piece, ends};
+                    place(line + 1, remaining - order, number_of_vertices + piece.number_of_vertices);
+                }
+            }
+        }
+        choices_[line] = {nullptr, {0, 0}};
+    }
+
+    void finish(int number_of_vertices) {
+        if (!options_.filter.accepts_vertex_count(number_of_vertices)) return;
+        EdgeList dashed = host_->dashed, solid;
+        std::vector<bool> replaced(host_->solid.size(), false);
+        int offset = host_->number_of_vertices;
+        for (std::size_t i = 0; i < lines_.size(); ++i) {
+            const Choice& c = choices_[i];
+            if (!c.piece) continue;
+            const auto& line = host_->solid[lines_[i]];
+            replaced[lines_[i]] = true;
+            for (const auto& e : c.piece->dashed) dashed.push_back({e.first + offset, e.second + offset});
+            for (const auto& e : c.piece->solid) solid.push_back({e.first + offset, e.second + offset});
+            solid.push_back({line.first, c.ends.first + offset});
+            solid.push_back({c.ends.second + offset, line.second});
+            offset += c.piece->number_of_vertices;
+        }
+        for (std::size_t l = 0; l < host_->solid.size(); ++l) {
+            if (!replaced[l]) solid.push_back(host_->solid[l]);
+        }
+        for (auto& e : solid) {
+            if (e.first > e.second) std::swap(e.first, e.second);
+        }
+        std::sort(dashed.begin(), dashed.end());
+        std::sort(solid.begin(), solid.end());
+        SimpleGraph G;
+        std::vector<SimpleGraph::vertex_descriptor> vertices;
+        if (build_diagram(options_, number_of_vertices, dashed, solid, G, vertices)) seen_.insert(G);
+    }
+
+    const EnumerationOptions& options_;
+    const std::vector<std::vector<Piece>>& pieces_;
+    DiagramDeduplicator& seen_;
+    const Piece* host_ = nullptr;
+    std::vector<std::size_t> lines_; // electron lines of the host
+    std::vector<Choice> choices_;
+};
+}
+
+EnumerationOptions piece_options(const EnumerationOptions& options, int order) {
+    EnumerationOptions pieces = options;
+    pieces.order = order;
+    pieces.include_improper = false;
+    pieces.skeleton_only = false;
+    pieces.filter.min_vertices = 1;
+    pieces.filter.topology = PhononTopology::Any;
+    return pieces;
+}
+
+long long compose_improper_diagrams(const EnumerationOptions& options, const CatalogueSource& proper,
+                                    const DiagramVisitor& visit) {
+    std::vector<Entry> entries;
+
+    // Chains of lower-order pieces.
+    std::vector<std::shared_ptr<const std::vector<SimpleGraph>>> catalogues(options.order + 1);
+    std::vector<std::vector<Piece>> pieces(options.order + 1);
+    for (int order = 1; order <= options.order; ++order) {
+        catalogues[order] = proper(piece_options(options, order));
+        if (order == options.order) break;
+        for (const auto& G : *catalogues[order]) pieces[order].push_back(make_piece(G));
+    }
+    ChainBuilder(options, pieces, entries).extend(options.order, 0, 0, -1);
+
+    // Proper diagrams of the full order, already in their first labelling.
+    for (const auto& G : *catalogues[options.order]) {
+        const int number_of_vertices = static_cast<int>(num_vertices(G));
+        if (!options.filter.accepts_vertex_count(number_of_vertices) || !options.filter.accepts_topology(G)) continue;
+        Entry entry{number_of_vertices, {}, {}, &G};
+        sorted_edges(G, entry.dashed, entry.solid);
+        entries.push_back(std::move(entry));
+    }
+
+    // A scan meets diagrams in (vertex count, phonon row, electron row) order.
+    std::sort(entries.begin(), entries.end(), entry_less);
+    // Distinct by construction; keys are computed only if the visitor asks.
+    for (const Entry& entry : entries) {
+        if (entry.proper) {
+            std::vector<SimpleGraph::vertex_descriptor> vertices(entry.number_of_vertices);
+            std::iota(vertices.begin(), vertices.end(), 0);
+            const ColourRefinement refinement = refine_colours(*entry.proper);
+            visit(*entry.proper, vertices, CanonicalKey(*entry.proper, refinement));
+        } else {
+            SimpleGraph G;
+            std::vector<SimpleGraph::vertex_descriptor> vertices;
+            build_diagram(options, entry.number_of_vertices, entry.dashed, entry.solid, G, vertices);
+            const ColourRefinement refinement = refine_colours(G);
+            visit(G, vertices, CanonicalKey(G, refinement));
+        }
+    }
+    return static_cast<long long>(entries.size());
+}
+
+long long count_non_skeleton_diagrams(const EnumerationOptions& options, const CatalogueSource& catalogues) {
+    EnumerationOptions proper = options;
+    proper.include_improper = false;
+    proper.skeleton_only = false;
+
+    // Self-energies of every lower order, proper or not.
+    std::vector<std::vector<Piece>> self_energies(options.order);
+    for (int order = 1; order < options.order; ++order) {
+        EnumerationOptions pieces = piece_options(options, order);
+        pieces.include_improper = true;
+        for (const auto& G : *catalogues(pieces)) self_energies[order].push_back(make_piece(G));
+    }
+
+    DiagramDeduplicator seen;
+    InsertionBuilder builder(proper, self_energies, seen);
+    // A one-line fermion loop carrying a self-energy is a loop of the run, so
+    // hosts may have such loops even when the run excludes them; the builder
+    // keeps only results without one.
+    for (int order = 1; order < options.order; ++order) {
+        EnumerationOptions skeletons = piece_options(options, order);
+        skeletons.skeleton_only = true;
+        skeletons.ignore_fermion_loop = false;
+        for (const auto& G : *catalogues(skeletons)) builder.insert_into(make_piece(G), options.order - order);
+    }
+    return seen.size();
+}
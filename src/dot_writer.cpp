@@ -0,0 +1,89 @@
+#include "dot_writer.hpp"
+#include <charconv>
+#include <vector>
+
+namespace {
+// Same text as "out << value" for a float with the default stream precision.
+void put_number(std::string& out, float value) {
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::general, 6);
+    out.append(buf, res.ptr);
+}
+
+void put_vertex(std::string& out, std::size_t id, const std::string& label, float x, float y, float size,
+                const std::string& fillcolor) {
+    out += std::to_string(id);
+    out += "[label=\"";
+    out += label;
+    out += "\", pos=\"";
+    put_number(out, x);
+    out += ',';
+    put_number(out, y);
+    out += "!\", width=\"";
+    put_number(out, size);
+    out += "\", height=\"";
+    put_number(out, size);
+    out += "\", fillcolor=\"";
+    out += fillcolor;
+    out += "\", style=filled];\n";
+}
+
+void put_edge(std::string& out, std::size_t a, std::size_t b, LineStyle style) {
+    out += std::to_string(a);
+    out += "--";
+    out += std::to_string(b);
+    out += " [style=\"";
+    out += to_dot_style(style);
+    out += "\"];\n";
+}
+}
+
+void append_dot(const SimpleGraph& G, std::string& out, const std::string& name) {
+    const std::size_t V = num_vertices(G);
+
+    // External legs: a short slanted line below each initial (leading in) and
+    // final (leading out) vertex, slanted away from the other end of the
+    // electron line.
+    const double length = 0.3;
+    std::size_t v_initial = 0, v_final = 0;
+    for (std::size_t v = 0; v < V; ++v) {
+        if (G[v].initial && !G[v].final) v_initial = v;
+        if (G[v].final && !G[v].initial) v_final = v;
+        if (G[v].final && G[v].initial) v_initial = v_final = v;
+    }
+    const double sign = G[v_initial].x > G[v_final].x ? -1.0 : 1.0;
+
+    struct Leg { std::size_t vertex; bool incoming; float x, y; };
+    std::vector<Leg> legs;
+    for (std::size_t v = 0; v < V; ++v) {
+        if (G[v].initial) legs.push_back({v, true, float(G[v].x - sign * length), float(G[v].y - length)});
+        if (G[v].final) legs.push_back({v, false, float(G[v].x + sign * length), float(G[v].y - length)});
+    }
+
+    out += "graph ";
+    out += name;
+    out += " {\nlayout=neato;\n";
+    for (std::size_t v = 0; v < V; ++v) put_vertex(out, v, G[v].label, G[v].x, G[v].y, G[v].size, G[v].fillcolor);
+    for (std::size_t i = 0; i < legs.size(); ++i) put_vertex(out, V + i, "", legs[i].x, legs[i].y, 0.0f, "white");
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        put_edge(out, source(*er.first, G), target(*er.first, G), G[*er.first].style);
+    }
+    for (std::size_t i = 0; i < legs.size(); ++i) {
+        if (legs[i].incoming) put_edge(out, V + i, legs[i].vertex, LineStyle::Solid);
+        else put_edge(out, legs[i].vertex, V + i, LineStyle::Solid);
+    }
+    out += "}\n";
+}
+
+void write_dot(const SimpleGraph& G, const std::string& path) {
+    std::string out;
+    append_dot(G, out);
+    std::ofstream file(path);
+    file << out;
+}
+
+void DotStreamWriter::add(const SimpleGraph& G, long long id) {
+    buffer_.clear();
+    append_dot(G, buffer_, "graph_" + std::to_string(id));
+    file_ << buffer_;
+}
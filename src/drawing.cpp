@@ -0,0 +1,307 @@
+#include "drawing.hpp"
+#include <cmath>
+#include <map>
+#include <algorithm>
+
+namespace {
+
+double len(Vec a) { return std::sqrt(a.x * a.x + a.y * a.y); }
+Vec unit(Vec a) { double l = len(a); return l > 1e-9 ? Vec{a.x / l, a.y / l} : Vec{0, 0}; }
+Vec perp(Vec a) { return {-a.y, a.x}; }
+
+Vec bezier(const Vec p[4], double t) {
+    double u = 1 - t, b0 = u * u * u, b1 = 3 * u * u * t, b2 = 3 * u * t * t, b3 = t * t * t;
+    return {b0 * p[0].x + b1 * p[1].x + b2 * p[2].x + b3 * p[3].x,
+            b0 * p[0].y + b1 * p[1].y + b2 * p[2].y + b3 * p[3].y};
+}
+Vec bezier_tangent(const Vec p[4], double t) {
+    double u = 1 - t, a0 = 3 * u * u, a1 = 6 * u * t, a2 = 3 * t * t;
+    return {a0 * (p[1].x - p[0].x) + a1 * (p[2].x - p[1].x) + a2 * (p[3].x - p[2].x),
+            a0 * (p[1].y - p[0].y) + a1 * (p[2].y - p[1].y) + a2 * (p[3].y - p[2].y)};
+}
+
+// --- batched curve kernel ---
+// Positions and tangents of a cubic Bezier for a whole run of parameters
+// t_i = i / N at once, in structure-of-arrays form. The loop bodies have no
+// cross-iteration dependence and no calls, so the compiler can vectorize them.
+struct CurveSamples {
+    std::vector<double> x, y, tx, ty;
+    void resize(int n) { x.resize(n); y.resize(n); tx.resize(n); ty.resize(n); }
+};
+
+void bezier_batch(const Vec p[4], int N, CurveSamples& s) {
+    s.resize(N + 1);
+    const double p0x = p[0].x, p1x = p[1].x, p2x = p[2].x, p3x = p[3].x;
+    const double p0y = p[0].y, p1y = p[1].y, p2y = p[2].y, p3y = p[3].y;
+    double* __restrict x = s.x.data();
+    double* __restrict y = s.y.data();
+    double* __restrict tx = s.tx.data();
+    double* __restrict ty = s.ty.data();
+    for (int i = 0; i <= N; ++i) {
+        const double t = (double)i / N, u = 1 - t;
+        const double b0 = u * u * u, b1 = 3 * u * u * t, b2 = 3 * u * t * t, b3 = t * t * t;
+        const double a0 = 3 * u * u, a1 = 6 * u * t, a2 = 3 * t * t;
+        x[i] = b0 * p0x + b1 * p1x + b2 * p2x + b3 * p3x;
+        y[i] = b0 * p0y + b1 * p1y + b2 * p2y + b3 * p3y;
+        tx[i] = a0 * (p1x - p0x) + a1 * (p2x - p1x) + a2 * (p3x - p2x);
+        ty[i] = a0 * (p1y - p0y) + a1 * (p2y - p1y) + a2 * (p3y - p2y);
+    }
+}
+
+// sin(i * step) for i = 0..N by rotating (cos, sin) through `step` instead of
+// calling std::sin per sample. The rounding error grows only linearly in N
+// (~1e-13 for the few hundred samples of a line), far below the 0.01 output
+// grid.
+void sine_carrier(double step, int N, std::vector<double>& out, std::vector<double>* cosines = nullptr) {
+    out.resize(N + 1);
+    if (cosines) cosines->resize(N + 1);
+    const double cd = std::cos(step), sd = std::sin(step);
+    double c = 1, s = 0;
+    for (int i = 0; i <= N; ++i) {
+        out[i] = s;
+        if (cosines) (*cosines)[i] = c;
+        const double next_c = c * cd - s * sd;
+        s = s * cd + c * sd;
+        c = next_c;
+    }
+}
+
+// Sample a cubic Bezier into a polyline; if wavy, ride a sine wave on the
+// normal (zero amplitude at the endpoints so it meets vertices cleanly).
+std::vector<Vec> curve_points(const Vec p[4], bool wavy, double amp, double wavelength) {
+    // Arc length from a 24-segment chord estimate, evaluated by the same kernel.
+    CurveSamples s;
+    bezier_batch(p, 24, s);
+    double L = 0;
+    for (int i = 1; i <= 24; ++i) L += std::hypot(s.x[i] - s.x[i - 1], s.y[i] - s.y[i - 1]);
+    int periods = std::max(2, (int)std::lround(L / wavelength));
+    int N = std::max(48, periods * 8);
+
+    bezier_batch(p, N, s);
+    std::vector<Vec> pts(N + 1);
+    if (!wavy) {
+        for (int i = 0; i <= N; ++i) pts[i] = {s.x[i], s.y[i]};
+        return pts;
+    }
+    std::vector<double> carrier;
+    sine_carrier(2.0 * M_PI * periods / N, N, carrier);
+    for (int i = 0; i <= N; ++i) {
+        // offset along the unit normal perp(tangent) = (-ty, tx) / |tangent|
+        const double l = std::sqrt(s.tx[i] * s.tx[i] + s.ty[i] * s.ty[i]);
+        const double k = l > 1e-9 ? amp * carrier[i] / l : 0.0;
+        pts[i] = {s.x[i] - s.ty[i] * k, s.y[i] + s.tx[i] * k};
+    }
+    return pts;
+}
+
+// A closed wavy circle of radius R centred at O, passing through the touch angle.
+std::vector<Vec> wavy_circle_points(Vec O, double R, double amp, double wavelength, double thetaP) {
+    int periods = std::max(8, (int)std::lround(2.0 * M_PI * R / wavelength));
+    int N = std::max(96, periods * 10);
+    // Direction (cos, sin)(theta_i - thetaP) and the carrier both advance by a
+    // fixed angle per sample; rotating by thetaP afterwards gives theta_i.
+    std::vector<double> sines, cosines, carrier;
+    sine_carrier(2.0 * M_PI / N, N, sines, &cosines);
+    sine_carrier(2.0 * M_PI * periods / N, N, carrier);
+    const double cp = std::cos(thetaP), sp = std::sin(thetaP);
+    std::vector<Vec> pts(N + 1);
+    for (int i = 0; i <= N; ++i) {
+        const double r = R + amp * carrier[i];
+        const double c = cosines[i] * cp - sines[i] * sp, s = sines[i] * cp + cosines[i] * sp;
+        pts[i] = {O.x + c * r, O.y + s * r};
+    }
+    return pts;
+}
+
+void arrowhead(DiagramSink& sink, Vec at, Vec dir, double size, double width) {
+    Vec t = unit(dir), n = perp(t);
+    Vec tip = at + t * (size * 0.5);
+    Vec b1 = at - t * (size * 0.5) + n * width;
+    Vec b2 = at - t * (size * 0.5) - n * width;
+    sink.arrowhead(tip, b1, b2);
+}
+
+// A wavy (or bowed) line through the cubic Bezier `ctrl`, placed at `origin`.
+void emit_curve(DiagramSink& sink, const std::string& id, const Vec ctrl[4], Vec origin, bool wavy, double amp,
+                double wavelength) {
+    Vec c[4] = {ctrl[0], ctrl[1], ctrl[2], ctrl[3]};
+    sink.curve(id, origin, false, [=](Vec offset) {
+        Vec local[4] = {c[0] - offset, c[1] - offset, c[2] - offset, c[3] - offset};
+        return curve_points(local, wavy, amp, wavelength);
+    });
+}
+
+} // namespace
+
+void draw_diagram(const SimpleGraph& G, DiagramSink& sink) {
+    const int V = (int)num_vertices(G);
+
+    struct E { int u, v; bool solid; };
+    std::vector<E> edges_v;
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        auto e = *er.first;
+        edges_v.push_back({(int)source(e, G), (int)target(e, G), G[e].style == LineStyle::Solid});
+    }
+    const int M = (int)edges_v.size();
+
+    // --- order vertices along the fermion (electron) line ---
+    // Walk the solid subgraph as a trail; this both orders the vertices left to
+    // right and orients each electron edge along the fermion flow.
+    std::vector<std::vector<std::pair<int, int>>> sinc(V); // (neighbor, edgeIndex)
+    std::vector<int> sdeg(V, 0);
+    for (int i = 0; i < M; ++i)
+        if (edges_v[i].solid) {
+            sinc[edges_v[i].u].push_back({edges_v[i].v, i});
+            sinc[edges_v[i].v].push_back({edges_v[i].u, i});
+            sdeg[edges_v[i].u]++; sdeg[edges_v[i].v]++;
+        }
+    std::vector<int> orderpos(V, -1);
+    std::vector<char> vvis(V, 0), eused(M, 0);
+    std::vector<int> a_from(M, -1), a_to(M, -1);
+    int next_order = 0;
+    auto walk = [&](int s) {
+        int cur = s;
+        while (cur >= 0) {
+            if (!vvis[cur]) { vvis[cur] = 1; orderpos[cur] = next_order++; }
+            int chosen = -1, nb = -1;
+            for (auto& pr : sinc[cur]) if (!eused[pr.second]) { chosen = pr.second; nb = pr.first; break; }
+            if (chosen < 0) break;
+            eused[chosen] = 1; a_from[chosen] = cur; a_to[chosen] = nb;
+            cur = nb;
+        }
+    };
+    // Prefer to start at the incoming external vertex so flow runs left to right.
+    int start = -1;
+    for (int v = 0; v < V; ++v) if (sdeg[v] == 1 && G[v].initial) { start = v; break; }
+    if (start < 0) for (int v = 0; v < V; ++v) if (sdeg[v] == 1) { start = v; break; }
+    if (start < 0) start = 0;
+    walk(start);
+    for (int v = 0; v < V; ++v) if (!vvis[v]) walk(v);
+    for (int i = 0; i < M; ++i) if (edges_v[i].solid && a_from[i] < 0) { a_from[i] = edges_v[i].u; a_to[i] = edges_v[i].v; }
+
+    // --- geometry constants ---
+    const double dx = 74, stub = 30, vr = 12, margin = 26;
+    const double amp = 4.5, wavelength = 11.0;
+    const double loop_R = 16, loop_spread = 0.85;
+
+    int cols = std::max(1, next_order);
+    auto px = [&](int v) { return margin + stub + orderpos[v] * dx; };
+
+    // group parallel edges (and self-loops) by vertex pair
+    std::map<std::pair<int, int>, std::vector<int>> groups;
+    for (int i = 0; i < M; ++i)
+        groups[{std::min(edges_v[i].u, edges_v[i].v), std::max(edges_v[i].u, edges_v[i].v)}].push_back(i);
+
+    // Decide how to draw each edge. Priority rules:
+    //  - a connection between two nodes is drawn straight when possible;
+    //  - only one edge per node pair can be straight (others bow into arcs);
+    //  - when choosing which edge is the straight one, the electron (solid)
+    //    line wins, so phonons bow away from it.
+    // A straight line is only sensible for adjacent nodes (span 1); longer
+    // connections always arc so they clear the nodes in between.
+    // For arcs, `gi` holds the stack level (which bow of the pair it is).
+    enum Kind { STRAIGHT_SOLID, STRAIGHT_PHONON, ARC_ABOVE, ARC_BELOW, SELFLOOP };
+    struct Cmd { Kind kind; int e; int lo, hi; double h; int gi, gn; };
+    std::vector<Cmd> cmds;
+    for (auto& kv : groups) {
+        const auto& ids = kv.second;
+        int n = (int)ids.size();
+        if (edges_v[ids[0]].u == edges_v[ids[0]].v) {
+            for (int gi = 0; gi < n; ++gi)
+                cmds.push_back({SELFLOOP, ids[gi], edges_v[ids[0]].u, edges_v[ids[0]].u, 0, gi, n});
+            continue;
+        }
+        int u = edges_v[ids[0]].u, v = edges_v[ids[0]].v;
+        int lo = orderpos[u] < orderpos[v] ? u : v, hi = (lo == u) ? v : u;
+        int span = std::abs(orderpos[u] - orderpos[v]);
+        int straight = -1;
+        if (span == 1) {                         // only adjacent nodes get a straight edge
+            for (int gi = 0; gi < n; ++gi) if (edges_v[ids[gi]].solid) { straight = gi; break; }
+            if (straight < 0) straight = 0;      // phonon-only pair: a phonon goes straight
+        }
+        int aboveStack = 0, belowStack = 0;
+        for (int gi = 0; gi < n; ++gi) {
+            int i = ids[gi];
+            bool solid = edges_v[i].solid;
+            if (gi == straight) {
+                cmds.push_back({solid ? STRAIGHT_SOLID : STRAIGHT_PHONON, i, lo, hi, 0, 0, 0});
+            } else if (solid) {
+                double h = 22.0 + 14.0 * (span - 1) + 12.0 * belowStack;
+                cmds.push_back({ARC_BELOW, i, lo, hi, h, belowStack++, 0});
+            } else {
+                double h = 26.0 + 20.0 * std::max(0, span - 1) + 18.0 * aboveStack;
+                cmds.push_back({ARC_ABOVE, i, lo, hi, h, aboveStack++, 0});
+            }
+        }
+    }
+
+    // measure vertical extents to size the canvas
+    double above = 2 * loop_R + amp + 6, below = 10;
+    for (const auto& c : cmds) {
+        if (c.kind == ARC_ABOVE || c.kind == SELFLOOP) above = std::max(above, (c.kind == SELFLOOP ? 2 * loop_R : c.h) + amp + 8);
+        if (c.kind == ARC_BELOW) below = std::max(below, c.h + 12);
+    }
+    double Y0 = margin + above;
+    sink.canvas(2 * margin + 2 * stub + (cols - 1) * dx, Y0 + below + margin + vr);
+    auto P = [&](int v) -> Vec { return {px(v), Y0}; };
+
+    // --- external legs (electron in/out) ---
+    auto stub_arrow = [&](int v, bool incoming) {
+        Vec p = P(v);
+        Vec tip = incoming ? p : p + Vec{stub, 0};
+        Vec tail = incoming ? p - Vec{stub, 0} : p;
+        sink.line(tail, tip);
+        Vec mid = (tail + tip) * 0.5;
+        arrowhead(sink, mid, {1, 0}, 8, 4.5);
+    };
+    for (int v = 0; v < V; ++v) if (G[v].initial) stub_arrow(v, true);   // incoming leg
+    for (int v = 0; v < V; ++v) if (G[v].final) stub_arrow(v, false);    // outgoing leg
+
+    // --- edges ---
+    auto solid_arrow_on_curve = [&](const Vec ctrl[4], int i) {
+        Vec m = bezier(ctrl, 0.5), tan = unit(bezier_tangent(ctrl, 0.5));
+        Vec flow = unit(P(a_to[i]) - P(a_from[i]));
+        if (tan.x * flow.x + tan.y * flow.y < 0) tan = tan * -1.0;
+        arrowhead(sink, m, tan, 8.5, 5);
+    };
+    for (const auto& c : cmds) {
+        if (c.kind == SELFLOOP) {
+            Vec p = P(c.lo);
+            double ang = (c.gi - (c.gn - 1) / 2.0) * loop_spread;
+            Vec dir = {std::cos(-M_PI / 2 + ang), std::sin(-M_PI / 2 + ang)};
+            Vec O = p + dir * loop_R;
+            double thetaP = std::atan2(-dir.y, -dir.x);
+            sink.curve("l" + std::to_string(c.gi) + "-" + std::to_string(c.gn), p, true, [&](Vec offset) {
+                return wavy_circle_points(O - offset, loop_R, amp * 0.7, wavelength, thetaP);
+            });
+            continue;
+        }
+        Vec A = P(c.lo), B = P(c.hi);
+        std::string span = std::to_string(orderpos[c.hi] - orderpos[c.lo]);
+        if (c.kind == STRAIGHT_SOLID) {
+            sink.line(A, B);
+            Vec flow = unit(P(a_to[c.e]) - P(a_from[c.e]));
+            arrowhead(sink, (A + B) * 0.5, flow, 8.5, 5);
+        } else if (c.kind == STRAIGHT_PHONON) {
+            Vec ctrl[4] = {A, A + (B - A) * (1.0 / 3.0), A + (B - A) * (2.0 / 3.0), B};
+            emit_curve(sink, "s" + span, ctrl, A, true, amp, wavelength);
+        } else if (c.kind == ARC_ABOVE) {
+            Vec ctrl[4] = {A, {A.x + (B.x - A.x) * 0.15, Y0 - c.h * 1.30},
+                           {B.x - (B.x - A.x) * 0.15, Y0 - c.h * 1.30}, B};
+            emit_curve(sink, "a" + span + "-" + std::to_string(c.gi), ctrl, A, true, amp, wavelength);
+        } else { // ARC_BELOW (extra electron line, e.g. a fermion loop)
+            Vec ctrl[4] = {A, {A.x + (B.x - A.x) * 0.2, Y0 + c.h * 1.30},
+                           {B.x - (B.x - A.x) * 0.2, Y0 + c.h * 1.30}, B};
+            emit_curve(sink, "b" + span + "-" + std::to_string(c.gi), ctrl, A, false, 0, wavelength);
+            solid_arrow_on_curve(ctrl, c.e);
+        }
+    }
+
+    // --- vertices ---
+    for (int v = 0; v < V; ++v) {
+        Vec p = P(v);
+        std::string fill = G[v].fillcolor.empty() ? "white" : G[v].fillcolor;
+        std::string tc = (fill == "white") ? "black" : "white";
+        sink.vertex(p, vr, fill, G[v].label, tc);
+    }
+}
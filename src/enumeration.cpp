@@ -0,0 +1,397 @@
+#include "enumeration.hpp"
+#include "utility.hpp"
+#include "composition.hpp"
+#include <algorithm>
+#include <numeric>
+#include <string>
+
+namespace {
+// Walk state for phonon (dashed) sets. A set can only yield a valid diagram if
+// every vertex carries a phonon line and, for skeletons on two or more
+// vertices, a non-tadpole one: a vertex whose only phonon lines are tadpoles
+// is cut off by its (at most two) electron lines, so the line is a bridge or
+// the vertex a self-energy insertion. Lines arrive in lexicographic order, so
+// once a line starts at vertex a no later line reaches a vertex below a; a
+// prefix leaving such a vertex bare, or more bare vertices than the remaining
+// lines can reach, has no valid completion. Degree-only filter terms prune in
+// the same pass.
+class DashedPrefix {
+public:
+    DashedPrefix(const EnumerationOptions& options, int number_of_vertices)
+        : filter_(options.filter), pairs_(all_vertex_pairs(number_of_vertices)), order_(options.order),
+          needs_links_(options.skeleton_only && number_of_vertices >= 2),
+          degree_(number_of_vertices, 0), links_(number_of_vertices, 0) {}
+
+    bool push(int index) {
+        const auto& e = pairs_[index];
+        const int first_open = lines_.empty() ? 0 : pairs_[lines_.back()].first;
+        lines_.push_back(index);
+        if (degree_[e.first]++ == 0) ++covered_;
+        if (degree_[e.second]++ == 0) ++covered_;
+        if (e.first != e.second) {
+            if (links_[e.first]++ == 0) ++linked_;
+            if (links_[e.second]++ == 0) ++linked_;
+        }
+        if (!filter_.accepts_dashed_line(e.first, e.second, degree_[e.first], degree_[e.second])) return false;
+        // Vertices in [first_open, e.first) just became unreachable.
+        for (int v = first_open; v < e.first; ++v) {
+            if (degree_[v] == 0 || (needs_links_ && links_[v] == 0)) return false;
+        }
+        const int vertices = static_cast<int>(degree_.size());
+        const int reach = 2 * (order_ - static_cast<int>(lines_.size()));
+        return vertices - covered_ <= reach && (!needs_links_ || vertices - linked_ <= reach);
+    }
+
+    void pop(int index) {
+        const auto& e = pairs_[index];
+        lines_.pop_back();
+        if (--degree_[e.first] == 0) --covered_;
+        if (--degree_[e.second] == 0) --covered_;
+        if (e.first != e.second) {
+            if (--links_[e.first] == 0) --linked_;
+            if (--links_[e.second] == 0) --linked_;
+        }
+    }
+
+    // Only meaningful on a complete set.
+    bool valid() const {
+        const int vertices = static_cast<int>(degree_.size());
+        return covered_ == vertices && (!needs_links_ || linked_ == vertices);
+    }
+
+private:
+    const DiagramFilter& filter_;
+    EdgeList pairs_;
+    int order_;
+    bool needs_links_;
+    std::vector<int> degree_; // phonon lines per vertex, a tadpole counting twice
+    std::vector<int> links_;  // non-tadpole phonon lines per vertex
+    int covered_ = 0, linked_ = 0;
+    std::vector<int> lines_;
+};
+
+// Walk state for electron (solid) sets: the shape check rejects any vertex
+// with more than two electron lines, so such prefixes are dropped at once.
+class SolidPrefix {
+public:
+    explicit SolidPrefix(int number_of_vertices)
+        : pairs_(all_vertex_pairs(number_of_vertices)), degree_(number_of_vertices, 0) {}
+
+    bool push(int index) {
+        const auto& e = pairs_[index];
+        ++degree_[e.first];
+        ++degree_[e.second];
+        return degree_[e.first] <= 2 && degree_[e.second] <= 2;
+    }
+    void pop(int index) {
+        const auto& e = pairs_[index];
+        --degree_[e.first];
+        --degree_[e.second];
+    }
+
+private:
+    EdgeList pairs_;
+    std::vector<int> degree_;
+};
+
+// Union-find over a few vertices, for electron components and the phonon
+// lines joining them.
+int find_root(std::vector<int>& parent, int v) {
+    while (parent[v] != v) v = parent[v] = parent[parent[v]];
+    return v;
+}
+
+// The partition of the vertices into components of `edges`, as one char per
+// vertex. Components are numbered by their first vertex, so equal partitions
+// get equal signatures; `component` receives the numbering if given.
+std::string component_signature(const EdgeList& edges, int number_of_vertices, std::vector<int>& parent,
+                                int* components = nullptr, std::vector<int>* component = nullptr) {
+    parent.resize(number_of_vertices);
+    std::iota(parent.begin(), parent.end(), 0);
+    for (const auto& e : edges) parent[find_root(parent, e.first)] = find_root(parent, e.second);
+    std::vector<int> number(number_of_vertices, -1);
+    int count = 0;
+    std::string signature;
+    for (int v = 0; v < number_of_vertices; ++v) {
+        int& n = number[find_root(parent, v)];
+        if (n < 0) n = count++;
+        signature += static_cast<char>(n);
+    }
+    if (components) *components = count;
+    if (component) component->assign(signature.begin(), signature.end());
+    return signature;
+}
+
+// The shape test of classify_and_validate_shape on the electron lines alone:
+// no electron loop if loops are ignored, and either one vertex without
+// electron lines and none with one, or none without and at most two with one.
+bool solid_shape_is_valid(const EdgeList& solid_edges, int number_of_vertices, bool ignore_fermion_loop) {
+    std::vector<int> degree(number_of_vertices, 0);
+    for (const auto& e : solid_edges) {
+        if (ignore_fermion_loop && e.first == e.second) return false;
+        ++degree[e.first];
+        ++degree[e.second];
+    }
+    const int unattached = static_cast<int>(std::count(degree.begin(), degree.end(), 0));
+    const int ends = static_cast<int>(std::count(degree.begin(), degree.end(), 1));
+    return unattached == 0 ? ends <= 2 : unattached == 1 && ends == 0;
+}
+}
+
+std::string catalogue_key(const EnumerationOptions& options) {
+    const DiagramFilter& f = options.filter;
+    return std::to_string(options.order) + " " + std::to_string(options.include_improper) + " " +
+           std::to_string(options.ignore_fermion_loop) + " " + std::to_string(options.skeleton_only) + " " +
+           std::to_string(f.min_vertices) + " " + std::to_string(f.max_vertices) + " " +
+           std::to_string(f.no_tadpoles) + " " + std::to_string(f.max_phonons_per_vertex) + " " +
+           std::to_string(static_cast<int>(f.topology));
+}
+
+EdgeList all_vertex_pairs(int number_of_vertices) {
+    EdgeList all_edges;
+    for (int i = 0; i < number_of_vertices; ++i) {
+        for (int j = i; j < number_of_vertices; ++j) {
+            all_edges.push_back({i, j});
+        }
+    }
+    return all_edges;
+}
+
+CandidateRows::CandidateRows(int number_of_vertices, int width)
+    : number_of_vertices_(number_of_vertices), width_(width), pairs_(all_vertex_pairs(number_of_vertices)) {}
+
+void CandidateRows::push_back(const std::vector<int>& pair_indices) {
+    indices_.insert(indices_.end(), pair_indices.begin(), pair_indices.end());
+    ++size_;
+}
+
+void CandidateRows::decode(std::size_t i, EdgeList& edges) const {
+    edges.clear();
+    for (auto it = indices_.begin() + i * width_, end = it + width_; it != end; ++it) edges.push_back(pairs_[*it]);
+}
+
+EdgeList CandidateRows::operator[](std::size_t i) const {
+    EdgeList edges;
+    decode(i, edges);
+    return edges;
+}
+
+long long CandidateRows::find(const EdgeList& edges) const {
+    if (static_cast<int>(edges.size()) != width_) return -1;
+    // Pair (a, b) sits after the n + (n - 1) + ... + (n - a + 1) pairs starting
+    // below a; rows are sorted, as are their pair indices.
+    const int n = number_of_vertices_;
+    std::vector<std::uint16_t> key;
+    for (const auto& e : edges) {
+        key.push_back(static_cast<std::uint16_t>(e.first * (2 * n - e.first + 1) / 2 + e.second - e.first));
+    }
+    std::size_t low = 0, high = size_;
+    while (low < high) {
+        const std::size_t mid = (low + high) / 2;
+        auto row = indices_.begin() + mid * width_;
+        if (std::lexicographical_compare(row, row + width_, key.begin(), key.end())) low = mid + 1;
+        else high = mid;
+    }
+    if (low == size_ || !std::equal(key.begin(), key.end(), indices_.begin() + low * width_)) return -1;
+    return static_cast<long long>(low);
+}
+
+CandidateRows dashed_candidates(const EnumerationOptions& options, int number_of_vertices) {
+    CandidateRows rows(number_of_vertices, options.order);
+    DashedPrefix prefix(options, number_of_vertices);
+    const int pairs = number_of_vertices * (number_of_vertices + 1) / 2;
+    enumerate_combinations(pairs, options.order, prefix, [&](const std::vector<int>& combo) {
+        if (prefix.valid()) rows.push_back(combo);
+    });
+    return rows;
+}
+
+CandidateRows solid_candidates(const EnumerationOptions&, int number_of_vertices) {
+    CandidateRows rows(number_of_vertices, number_of_vertices - 1);
+    SolidPrefix prefix(number_of_vertices);
+    const int pairs = number_of_vertices * (number_of_vertices + 1) / 2;
+    enumerate_combinations(pairs, number_of_vertices - 1, prefix,
+                           [&](const std::vector<int>& combo) { rows.push_back(combo); });
+    return rows;
+}
+
+CandidateJoin::CandidateJoin(const EnumerationOptions& options, int number_of_vertices)
+    : number_of_vertices_(number_of_vertices), dashed_(dashed_candidates(options, number_of_vertices)),
+      solid_(solid_candidates(options, number_of_vertices)) {
+    std::unordered_map<std::string, int> bucket_of;
+    EdgeList edges;
+    std::vector<int> parent;
+    for (std::size_t row = 0; row < solid_.size(); ++row) {
+        solid_.decode(row, edges);
+        if (!solid_shape_is_valid(edges, number_of_vertices, options.ignore_fermion_loop)) continue;
+        Bucket b;
+        const std::string signature = component_signature(edges, number_of_vertices, parent, &b.components, &b.component);
+        auto bucket = bucket_of.emplace(signature, static_cast<int>(buckets_.size()));
+        if (bucket.second) buckets_.push_back(std::move(b));
+        shaped_rows_.push_back(row);
+        shaped_buckets_.push_back(bucket.first->second);
+    }
+    // The probe side: whether a phonon row connects a bucket depends only on
+    // its own component partition, so each distinct partition is matched
+    // against the buckets once and its partners stored as runs.
+    for (std::size_t row = 0; row < dashed_.size(); ++row) {
+        dashed_.decode(row, edges);
+        auto probe = probe_.emplace(component_signature(edges, number_of_vertices, parent), std::vector<Run>());
+        if (probe.second) compatible_runs(edges, probe.first->second);
+    }
+}
+
+void CandidateJoin::compatible_runs(const EdgeList& dashed_edges, std::vector<Run>& runs) const {
+    std::vector<char> compatible(buckets_.size(), 0);
+    std::vector<int> parent;
+    for (std::size_t i = 0; i < buckets_.size(); ++i) {
+        const Bucket& bucket = buckets_[i];
+        parent.resize(bucket.components);
+        std::iota(parent.begin(), parent.end(), 0);
+        int joins = 0;
+        for (const auto& e : dashed_edges) {
+            const int a = find_root(parent, bucket.component[e.first]), b = find_root(parent, bucket.component[e.second]);
+            if (a != b) {
+                parent[a] = b;
+                ++joins;
+            }
+        }
+        compatible[i] = joins + 1 == bucket.components;
+    }
+    runs.clear();
+    for (std::size_t i = 0; i < shaped_buckets_.size(); ++i) {
+        if (!compatible[shaped_buckets_[i]]) continue;
+        if (!runs.empty() && runs.back().second == i) ++runs.back().second;
+        else runs.push_back({i, i + 1});
+    }
+}
+
+void CandidateJoin::partners(const EdgeList& dashed_edges, std::vector<std::size_t>& solid_rows) const {
+    solid_rows.clear();
+    std::vector<int> parent;
+    std::vector<Run> unindexed;
+    auto probe = probe_.find(component_signature(dashed_edges, number_of_vertices_, parent));
+    if (probe == probe_.end()) compatible_runs(dashed_edges, unindexed); // not one of dashed()
+    for (const Run& run : probe == probe_.end() ? unindexed : probe->second) {
+        solid_rows.insert(solid_rows.end(), shaped_rows_.begin() + run.first, shaped_rows_.begin() + run.second);
+    }
+}
+
+bool build_diagram(const EnumerationOptions& options, int number_of_vertices,
+                   const EdgeList& dashed_edges, const EdgeList& solid_edges,
+                   SimpleGraph& G, std::vector<SimpleGraph::vertex_descriptor>& vertices) {
+    // Initialize graph
+    std::tie(G, vertices) = get_initial_graph_and_vertices(number_of_vertices);
+
+    // Add phonon (dashed) and electron (solid) edges
+    add_styled_edges(G, vertices, dashed_edges, /*dashed=*/true);
+    add_styled_edges(G, vertices, solid_edges, /*dashed=*/false);
+
+    // Keep only connected, well-shaped self-energy diagrams
+    if (!is_fully_connected(G, vertices)) {
+        return false;
+    }
+    if (!classify_and_validate_shape(G, vertices, options.ignore_fermion_loop)) {
+        return false;
+    }
+
+    // By default keep only proper (1PI) diagrams
+    if (!options.include_improper && !is_proper_diagram(G)) {
+        return false;
+    }
+    if (options.skeleton_only && !is_skeleton_diagram(G)) {
+        return false;
+    }
+
+    // Topology terms are isomorphism-invariant, so they can reject
+    // before the (comparatively costly) canonical labelling.
+    if (!options.filter.accepts_topology(G)) {
+        return false;
+    }
+
+    // Labeling: show each vertex's phonon-line count
+    for (const auto& v : vertices) {
+        G[v].label = std::to_string(G[v].dashed_degree);
+    }
+    return true;
+}
+
+bool DiagramDeduplicator::insert(const SimpleGraph& G, const std::function<void(const CanonicalKey&)>& emit) {
+    ColourRefinement refinement = refine_colours(G);
+    auto bucket = buckets_.try_emplace(refinement.invariant);
+    if (bucket.second) {
+        // Nothing seen so far shares G's invariant, so G is new.
+        CanonicalKey key(G, refinement);
+        emit(key);
+        ++size_;
+        if (key.computed()) {
+            keys_.insert(key.str());
+        } else {
+            bucket.first->second.reset(new Pending{diagram_lines(G), std::move(refinement)});
+        }
+        return true;
+    }
+    if (auto& pending = bucket.first->second) {
+        keys_.insert(canonical_form(pending->lines, pending->refinement));
+        pending.reset();
+    }
+    auto inserted = keys_.insert(canonical_form(G, refinement));
+    if (!inserted.second) return false;
+    ++size_;
+    emit(CanonicalKey(*inserted.first));
+    return true;
+}
+
+long long scan_diagrams(const EnumerationOptions& options, const DiagramVisitor& visit, ScanStats* stats) {
+    // A candidate is a duplicate exactly when an isomorphic diagram was
+    // emitted before. Most accepted candidates are duplicates, so only a short
+    // key (or, for a bucket's lone occupant, its line list) is kept per diagram.
+    DiagramDeduplicator seen;
+
+    for (int number_of_vertices = 1; number_of_vertices <= 2 * options.order; ++number_of_vertices) {
+        if (!options.filter.accepts_vertex_count(number_of_vertices)) {
+            continue;
+        }
+
+        // Pre-filter the edge sets once per vertex count, keeping only those that
+        // can still produce a valid diagram, and pair them through the join
+        // (preserving enumeration order so the surviving candidate sequence is a
+        // subsequence of the brute-force one).
+        const CandidateJoin join(options, number_of_vertices);
+
+        EdgeList dashed_edges, solid_edges;
+        std::vector<std::size_t> partners;
+        for (std::size_t d = 0; d < join.dashed().size(); ++d) {
+            join.dashed().decode(d, dashed_edges);
+            join.partners(dashed_edges, partners);
+            if (stats) {
+                stats->pairs += static_cast<long long>(join.solid().size());
+                stats->joined += static_cast<long long>(partners.size());
+            }
+            for (std::size_t s : partners) {
+                join.solid().decode(s, solid_edges);
+                SimpleGraph G;
+                std::vector<SimpleGraph::vertex_descriptor> vertices;
+                if (!build_diagram(options, number_of_vertices, dashed_edges, solid_edges, G, vertices)) {
+                    continue;
+                }
+                seen.insert(G, [&](const CanonicalKey& key) { visit(G, vertices, key); });
+            }
+        }
+    }
+    return seen.size();
+}
+
+long long enumerate_diagrams(const EnumerationOptions& options, const DiagramVisitor& visit) {
+    if (!options.include_improper) {
+        return scan_diagrams(options, visit);
+    }
+    return compose_improper_diagrams(options, enumerate_catalogue, visit);
+}
+
+std::shared_ptr<const std::vector<SimpleGraph>> enumerate_catalogue(const EnumerationOptions& options) {
+    auto catalogue = std::make_shared<std::vector<SimpleGraph>>();
+    enumerate_diagrams(options, [&](const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>&,
+                                    const CanonicalKey&) { catalogue->push_back(G); });
+    return catalogue;
+}
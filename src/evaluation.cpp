@@ -0,0 +1,381 @@
+#include "evaluation.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+namespace {
+std::string trim(const std::string& s) {
+    std::size_t b = s.find_first_not_of(" \t"), e = s.find_last_not_of(" \t");
+    return b == std::string::npos ? "" : s.substr(b, e - b + 1);
+}
+
+bool parse_number(const std::string& text, double& value) {
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0' && std::isfinite(value);
+}
+
+bool parse_count(const std::string& text, int& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos || text.size() > 6) return false;
+    value = std::stoi(text);
+    return value > 0;
+}
+
+// "a:b" -> (a, b)
+bool parse_pair(const std::string& text, std::string& a, std::string& b) {
+    std::size_t colon = text.find(':');
+    if (colon == std::string::npos) return false;
+    a = text.substr(0, colon);
+    b = text.substr(colon + 1);
+    return true;
+}
+
+using Frequency = std::vector<int>; // coefficients over (external, nu_0.., lambda_0..)
+
+// Electron lines walked from `start` until the line runs out (the backbone,
+// from the initial vertex) or returns to `start` (a closed loop).
+std::vector<int> walk_electron_line(const std::vector<std::vector<std::pair<int, int>>>& solid, int start,
+                                    std::vector<bool>& used_line, std::vector<bool>& visited) {
+    std::vector<int> walk{start};
+    visited[start] = true;
+    int current = start;
+    while (true) {
+        int next = -1;
+        for (const auto& line : solid[current]) {
+            if (!used_line[line.first]) {
+                used_line[line.first] = true;
+                next = line.second;
+                break;
+            }
+        }
+        if (next < 0 || next == start) break;
+        walk.push_back(next);
+        visited[next] = true;
+        current = next;
+    }
+    return walk;
+}
+
+// Propagator tables over the Matsubara indices a run can reach, as separate
+// real/imaginary arrays so the batched products vectorize.
+struct PropagatorTables {
+    int offset; // table position of index 0
+    std::vector<double> electron_re, electron_im; // G0 at k = 2m + 1
+    std::vector<double> phonon;                   // -g^2 D0 at k = 2m
+};
+
+PropagatorTables make_tables(const HolsteinModel& model, int max_k) {
+    PropagatorTables t;
+    t.offset = max_k / 2 + 2;
+    const int size = 2 * t.offset + 1;
+    t.electron_re.assign(size, 0.0);
+    t.electron_im.assign(size, 0.0);
+    t.phonon.assign(size, 0.0);
+    std::vector<std::pair<double, double>> levels = model.levels;
+    if (levels.empty()) levels.push_back({0.0, 1.0});
+    const double pi_t = M_PI / model.beta, w0 = model.phonon_frequency, g2 = model.coupling * model.coupling;
+    for (int i = 0; i < size; ++i) {
+        const int m = i - t.offset;
+        const double omega = (2 * m + 1) * pi_t, nu = 2 * m * pi_t;
+        for (const auto& level : levels) {
+            // w / (i omega - xi) = w (-xi - i omega) / (xi^2 + omega^2)
+            const double xi = level.first - model.chemical_potential;
+            const double denominator = xi * xi + omega * omega;
+            t.electron_re[i] += level.second * -xi / denominator;
+            t.electron_im[i] += level.second * -omega / denominator;
+        }
+        t.phonon[i] = g2 * 2.0 * w0 / (nu * nu + w0 * w0);
+    }
+    return t;
+}
+
+// Table position of propagator p at external index n = 0 and its stride in n,
+// for internal frequencies k (in units of pi T).
+void locate(const Propagator& p, const std::array<int, max_internal_frequencies>& k, int count, int offset,
+            int& start, int& stride) {
+    int total = p.external; // k at n = 0
+    for (int j = 0; j < count; ++j) total += p.internal[j] * k[j];
+    // k(n) = 2 external n + total; fermionic index (k - 1) / 2, bosonic k / 2
+    start = offset + (p.phonon ? total / 2 : (total - 1) / 2);
+    stride = p.external;
+}
+}
+
+bool parse_model(const std::string& expression, HolsteinModel& model, std::string& error) {
+    std::size_t begin = 0;
+    while (begin <= expression.size()) {
+        std::size_t end = expression.find(',', begin);
+        if (end == std::string::npos) end = expression.size();
+        const std::string term = trim(expression.substr(begin, end - begin));
+        begin = end + 1;
+        if (term.empty()) continue;
+
+        std::size_t equals = term.find('=');
+        const std::string name = term.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : term.substr(equals + 1);
+        std::string a, b;
+        double x = 0, y = 0;
+        int count = 0;
+        bool ok = true;
+        if (name == "beta") {
+            ok = parse_number(value, model.beta) && model.beta > 0;
+        } else if (name == "mu") {
+            ok = parse_number(value, model.chemical_potential);
+        } else if (name == "g") {
+            ok = parse_number(value, model.coupling);
+        } else if (name == "omega0") {
+            ok = parse_number(value, model.phonon_frequency) && model.phonon_frequency > 0;
+        } else if (name == "level") {
+            ok = parse_pair(value, a, b) && parse_number(a, x) && parse_number(b, y);
+            if (ok) model.levels.push_back({x, y});
+        } else if (name == "chain") {
+            ok = parse_pair(value, a, b) && parse_number(a, x) && parse_count(b, count);
+            for (int k = 0; ok && k < count; ++k) {
+                model.levels.push_back({-2.0 * x * std::cos(2.0 * M_PI * k / count), 1.0 / count});
+            }
+        } else if (name == "cutoff") {
+            ok = parse_count(value, model.cutoff);
+        } else if (name == "frequencies") {
+            ok = parse_count(value, model.frequencies);
+        } else {
+            error = "unknown model term '" + term + "'";
+            return false;
+        }
+        if (!ok) {
+            error = "bad model term '" + term + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool compile_diagram(const SimpleGraph& G, CompiledDiagram& compiled) {
+    const int V = static_cast<int>(num_vertices(G));
+    std::vector<std::pair<int, int>> phonons;
+    std::vector<std::vector<std::pair<int, int>>> solid(V); // (line, other end)
+    int solid_lines = 0;
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        const int a = static_cast<int>(source(*er.first, G)), b = static_cast<int>(target(*er.first, G));
+        if (G[*er.first].style == LineStyle::Dashed) {
+            phonons.push_back({a, b});
+        } else {
+            solid[a].push_back({solid_lines, b});
+            solid[b].push_back({solid_lines, a});
+            ++solid_lines;
+        }
+    }
+    const int n = static_cast<int>(phonons.size());
+
+    // The backbone from the initial vertex, then every closed loop.
+    std::vector<bool> used_line(solid_lines, false), visited(V, false);
+    int initial = 0;
+    for (int v = 0; v < V; ++v) if (G[v].initial) { initial = v; break; }
+    std::vector<std::vector<int>> walks{walk_electron_line(solid, initial, used_line, visited)};
+    for (int v = 0; v < V; ++v) {
+        if (!visited[v]) walks.push_back(walk_electron_line(solid, v, used_line, visited));
+    }
+    const int loops = static_cast<int>(walks.size()) - 1;
+    const int width = 1 + n + loops;
+
+    // Phonon frequency leaving each vertex: nu_j flows from its first end to
+    // its second (a tadpole leaves and re-enters the same vertex).
+    std::vector<Frequency> emitted(V, Frequency(width, 0));
+    for (int j = 0; j < n; ++j) {
+        emitted[phonons[j].first][1 + j] += 1;
+        emitted[phonons[j].second][1 + j] -= 1;
+    }
+
+    // Every line's frequency, and per loop the conservation constraint
+    // (what the loop emits in total must vanish).
+    std::vector<Frequency> lines;
+    std::vector<bool> line_is_phonon;
+    for (int j = 0; j < n; ++j) {
+        Frequency f(width, 0);
+        f[1 + j] = 1;
+        lines.push_back(f);
+        line_is_phonon.push_back(true);
+    }
+    std::vector<Frequency> constraints;
+    for (int w = 0; w <= loops; ++w) {
+        const std::vector<int>& walk = walks[w];
+        const bool closed = w > 0;
+        Frequency f(width, 0), total(width, 0);
+        f[closed ? n + w : 0] = 1; // external frequency, or the loop's own
+        const std::size_t steps = closed ? walk.size() : walk.size() - 1;
+        for (std::size_t i = 0; i < steps; ++i) {
+            for (int c = 0; c < width; ++c) {
+                f[c] -= emitted[walk[i]][c];
+                total[c] += emitted[walk[i]][c];
+            }
+            lines.push_back(f);
+            line_is_phonon.push_back(false);
+        }
+        if (closed) constraints.push_back(total);
+    }
+
+    // Solve each constraint for one phonon frequency. Constraints are rows of
+    // an incidence matrix, so a pivot of +-1 always exists.
+    std::vector<bool> eliminated(width, false);
+    for (std::size_t r = 0; r < constraints.size(); ++r) {
+        const Frequency c = constraints[r];
+        int pivot = -1;
+        for (int j = 1; j <= n; ++j) {
+            if (!eliminated[j] && (c[j] == 1 || c[j] == -1)) { pivot = j; break; }
+        }
+        if (pivot < 0) continue; // dependent on earlier constraints
+        eliminated[pivot] = true;
+        auto substitute = [&](Frequency& f) {
+            const int factor = f[pivot] * c[pivot]; // nu_pivot = -c[pivot] * (c - c[pivot] e_pivot)
+            if (factor == 0) return;
+            for (int i = 0; i < width; ++i) f[i] -= factor * c[i];
+        };
+        for (auto& f : lines) substitute(f);
+        for (std::size_t s = r + 1; s < constraints.size(); ++s) substitute(constraints[s]);
+    }
+
+    std::vector<int> free_frequencies;
+    compiled = CompiledDiagram{};
+    for (int i = 1; i < width; ++i) {
+        if (eliminated[i]) continue;
+        free_frequencies.push_back(i);
+        compiled.fermionic.push_back(i > n);
+    }
+    if (static_cast<int>(free_frequencies.size()) > max_internal_frequencies) return false;
+
+    compiled.order = n;
+    compiled.sign = loops % 2 ? -1.0 : 1.0;
+    for (std::size_t l = 0; l < lines.size(); ++l) {
+        Propagator p{line_is_phonon[l], lines[l][0], {}};
+        for (std::size_t j = 0; j < free_frequencies.size(); ++j) p.internal[j] = lines[l][free_frequencies[j]];
+        compiled.propagators.push_back(p);
+    }
+    return true;
+}
+
+std::vector<std::vector<std::complex<double>>> evaluate_diagrams(const std::vector<CompiledDiagram>& diagrams,
+                                                                 const HolsteinModel& model, int threads) {
+    const int N = model.frequencies, M = model.cutoff;
+    std::vector<std::vector<std::complex<double>>> result(diagrams.size(), std::vector<std::complex<double>>(N));
+
+    // Largest |k| any propagator reaches, to size the tables.
+    int max_k = 0;
+    for (const auto& d : diagrams) {
+        for (const auto& p : d.propagators) {
+            int k = std::abs(p.external) * (2 * N - 1);
+            for (std::size_t j = 0; j < d.fermionic.size(); ++j) k += std::abs(p.internal[j]) * (2 * M + 1);
+            max_k = std::max(max_k, k);
+        }
+    }
+    const PropagatorTables tables = make_tables(model, max_k);
+
+    // Index range of each internal frequency: |omega| <= 2 pi T cutoff.
+    const int low = -M;
+    auto high = [M](bool fermionic) { return fermionic ? M - 1 : M; };
+
+    // One task per (diagram, value of its outermost internal index).
+    std::vector<std::pair<std::size_t, int>> tasks;
+    for (std::size_t d = 0; d < diagrams.size(); ++d) {
+        const auto& f = diagrams[d].fermionic;
+        if (f.empty()) {
+            tasks.push_back({d, 0});
+            continue;
+        }
+        for (int m = low; m <= high(f[0]); ++m) tasks.push_back({d, m});
+    }
+
+    std::atomic<std::size_t> next_task{0};
+    std::mutex result_mutex;
+    auto work = [&]() {
+        std::vector<double> sum_re(N), sum_im(N), term_re(N), term_im(N);
+        std::size_t current = diagrams.size();
+        auto flush = [&]() {
+            if (current == diagrams.size()) return;
+            const CompiledDiagram& d = diagrams[current];
+            const double prefactor = d.sign * std::pow(1.0 / model.beta, static_cast<double>(d.fermionic.size()));
+            std::lock_guard<std::mutex> lock(result_mutex);
+            for (int i = 0; i < N; ++i) result[current][i] += prefactor * std::complex<double>(sum_re[i], sum_im[i]);
+        };
+
+        for (std::size_t t; (t = next_task++) < tasks.size();) {
+            if (tasks[t].first != current) {
+                flush();
+                current = tasks[t].first;
+                std::fill(sum_re.begin(), sum_re.end(), 0.0);
+                std::fill(sum_im.begin(), sum_im.end(), 0.0);
+            }
+            const CompiledDiagram& d = diagrams[current];
+            const int L = static_cast<int>(d.fermionic.size());
+            std::array<int, max_internal_frequencies> m{}, k{};
+            m[0] = tasks[t].second;
+            for (int j = 1; j < L; ++j) m[j] = low;
+
+            while (true) {
+                for (int j = 0; j < L; ++j) k[j] = d.fermionic[j] ? 2 * m[j] + 1 : 2 * m[j];
+
+                // Propagators without the external frequency are one factor for
+                // the whole grid; the others are multiplied in across it.
+                double scalar_re = 1.0, scalar_im = 0.0;
+                for (const auto& p : d.propagators) {
+                    int start, stride;
+                    locate(p, k, L, tables.offset, start, stride);
+                    if (stride != 0) continue;
+                    if (p.phonon) {
+                        scalar_re *= tables.phonon[start];
+                        scalar_im *= tables.phonon[start];
+                    } else {
+                        const double re = tables.electron_re[start], im = tables.electron_im[start];
+                        const double r = scalar_re * re - scalar_im * im;
+                        scalar_im = scalar_re * im + scalar_im * re;
+                        scalar_re = r;
+                    }
+                }
+                std::fill(term_re.begin(), term_re.end(), scalar_re);
+                std::fill(term_im.begin(), term_im.end(), scalar_im);
+                for (const auto& p : d.propagators) {
+                    int start, stride;
+                    locate(p, k, L, tables.offset, start, stride);
+                    if (stride == 0) continue;
+                    if (p.phonon) {
+                        const double* ph = tables.phonon.data() + start;
+                        for (int i = 0; i < N; ++i) {
+                            term_re[i] *= ph[i * stride];
+                            term_im[i] *= ph[i * stride];
+                        }
+                    } else {
+                        const double* g_re = tables.electron_re.data() + start;
+                        const double* g_im = tables.electron_im.data() + start;
+                        for (int i = 0; i < N; ++i) {
+                            const double re = term_re[i] * g_re[i * stride] - term_im[i] * g_im[i * stride];
+                            term_im[i] = term_re[i] * g_im[i * stride] + term_im[i] * g_re[i * stride];
+                            term_re[i] = re;
+                        }
+                    }
+                }
+                for (int i = 0; i < N; ++i) {
+                    sum_re[i] += term_re[i];
+                    sum_im[i] += term_im[i];
+                }
+
+                // Advance the inner indices like an odometer.
+                int j = L - 1;
+                while (j >= 1 && ++m[j] > high(d.fermionic[j])) {
+                    m[j] = low;
+                    --j;
+                }
+                if (j < 1) break;
+            }
+        }
+        flush();
+    };
+
+    if (threads <= 0) threads = static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::max(1, std::min<int>(threads, static_cast<int>(tasks.size())));
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; ++i) pool.emplace_back(work);
+    work();
+    for (auto& th : pool) th.join();
+    return result;
+}
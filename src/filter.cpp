@@ -0,0 +1,119 @@
+#include "filter.hpp"
+#include <algorithm>
+
+bool DiagramFilter::accepts_topology(const SimpleGraph& G) const {
+    if (topology == PhononTopology::Any) return true;
+    const int V = static_cast<int>(num_vertices(G));
+
+    // Position of each vertex along the electron backbone, walked from the
+    // initial vertex. Vertices off the backbone (closed fermion loops) leave
+    // the topology undefined, so such diagrams match no topology term.
+    std::vector<int> position(V, -1);
+    int start = -1;
+    for (int v = 0; v < V; ++v) if (G[v].initial) { start = v; break; }
+    if (start < 0) return false;
+    int prev = -1, cur = start, next_position = 0;
+    while (cur >= 0) {
+        position[cur] = next_position++;
+        int next = -1;
+        for (auto it = out_edges(cur, G); it.first != it.second; ++it.first) {
+            if (G[*it.first].style != LineStyle::Solid) continue;
+            int w = static_cast<int>(target(*it.first, G));
+            if (w != prev && position[w] < 0) { next = w; break; }
+        }
+        prev = cur;
+        cur = next;
+    }
+    if (next_position != V) return false;
+
+    std::vector<std::pair<int, int>> spans;
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        if (G[*er.first].style != LineStyle::Dashed) continue;
+        int a = position[source(*er.first, G)], b = position[target(*er.first, G)];
+        if (a == b) continue;
+        spans.push_back({std::min(a, b), std::max(a, b)});
+    }
+
+    bool any_crossed = false, all_nested = true, all_side_by_side = true;
+    for (std::size_t i = 0; i < spans.size(); ++i) {
+        for (std::size_t j = i + 1; j < spans.size(); ++j) {
+            int a = spans[i].first, b = spans[i].second, c = spans[j].first, d = spans[j].second;
+            bool crossed = (a < c && c < b && b < d) || (c < a && a < d && d < b);
+            bool nested = (a <= c && d <= b) || (c <= a && b <= d);
+            bool side_by_side = b <= c || d <= a;
+            any_crossed = any_crossed || crossed;
+            all_nested = all_nested && nested;
+            all_side_by_side = all_side_by_side && side_by_side;
+        }
+    }
+
+    switch (topology) {
+        case PhononTopology::Rainbow: return all_nested;
+        case PhononTopology::Ladder: return all_side_by_side;
+        case PhononTopology::Crossed: return any_crossed;
+        default: return true;
+    }
+}
+
+namespace {
+std::string trim(const std::string& s) {
+    std::size_t b = s.find_first_not_of(" \t"), e = s.find_last_not_of(" \t");
+    return b == std::string::npos ? "" : s.substr(b, e - b + 1);
+}
+
+bool parse_count(const std::string& text, int& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos || text.size() > 6) return false;
+    value = std::stoi(text);
+    return true;
+}
+
+bool set_topology(DiagramFilter& filter, PhononTopology topology, const std::string& term, std::string& error) {
+    if (filter.topology != PhononTopology::Any && filter.topology != topology) {
+        error = "conflicting topology term '" + term + "'";
+        return false;
+    }
+    filter.topology = topology;
+    return true;
+}
+}
+
+bool parse_filter(const std::string& expression, DiagramFilter& filter, std::string& error) {
+    std::size_t begin = 0;
+    while (begin <= expression.size()) {
+        std::size_t end = expression.find(',', begin);
+        if (end == std::string::npos) end = expression.size();
+        const std::string term = trim(expression.substr(begin, end - begin));
+        begin = end + 1;
+        if (term.empty()) continue;
+
+        int value = 0;
+        if (term.rfind("vertices", 0) == 0) {
+            std::string rest = term.substr(8);
+            if (rest.rfind("<=", 0) == 0 && parse_count(rest.substr(2), value)) {
+                filter.max_vertices = std::min(filter.max_vertices, value);
+            } else if (rest.rfind(">=", 0) == 0 && parse_count(rest.substr(2), value)) {
+                filter.min_vertices = std::max(filter.min_vertices, value);
+            } else if (rest.rfind("=", 0) == 0 && parse_count(rest.substr(1), value)) {
+                filter.min_vertices = std::max(filter.min_vertices, value);
+                filter.max_vertices = std::min(filter.max_vertices, value);
+            } else {
+                error = "bad vertex-count term '" + term + "'";
+                return false;
+            }
+        } else if (term.rfind("maxphonon=", 0) == 0 && parse_count(term.substr(10), value)) {
+            filter.max_phonons_per_vertex = std::min(filter.max_phonons_per_vertex, value);
+        } else if (term == "notadpole") {
+            filter.no_tadpoles = true;
+        } else if (term == "rainbow") {
+            if (!set_topology(filter, PhononTopology::Rainbow, term, error)) return false;
+        } else if (term == "ladder") {
+            if (!set_topology(filter, PhononTopology::Ladder, term, error)) return false;
+        } else if (term == "crossed") {
+            if (!set_topology(filter, PhononTopology::Crossed, term, error)) return false;
+        } else {
+            error = "unknown filter term '" + term + "'";
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,168 @@
+#include "gallery_writer.hpp"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+namespace {
+
+std::string fmt(double v) {
+    std::ostringstream o; o.precision(2); o << std::fixed << v; return o.str();
+}
+
+// The page: toolbar, a scroll box whose spacer has the height of the whole
+// filtered grid, and the script that keeps only the visible rows in the DOM.
+// The blob and metadata sit in inert <script> blocks and are read once.
+const char* const page_style = R"(<style>
+body{margin:0;font-family:sans-serif;background:#f4f4f4}
+#bar{height:44px;display:flex;gap:16px;align-items:center;padding:0 12px;background:#fff;border-bottom:1px solid #ccc}
+#view{position:absolute;top:45px;bottom:0;left:0;right:0;overflow-y:auto}
+#space{position:relative}
+.cell{position:absolute;box-sizing:border-box;padding:4px;border:1px solid #ddd;background:#fff}
+.cell svg{display:block;width:100%}
+.cell p{margin:2px 0 0;font-size:12px;text-align:center;color:#333}
+</style>
+)";
+
+const char* const page_script = R"(<script>
+(function () {
+  var blob = document.getElementById('blob').textContent;
+  var meta = JSON.parse(document.getElementById('meta').textContent);
+  var layout = meta.cell, rows = meta.diagrams; // [id, offset, length, width, height, vertices, degrees]
+  var view = document.getElementById('view'), space = document.getElementById('space');
+  var shown = [], live = new Map(), columns = 1, pending = false;
+
+  function maxDegree(d) { return d[6] ? parseInt(d[6], 10) : 0; }
+  function options(select, values, label) {
+    values.forEach(function (v) {
+      var o = document.createElement('option');
+      o.value = v; o.textContent = label(v); select.appendChild(o);
+    });
+  }
+  function distinct(f, compare) {
+    var seen = {}, out = [];
+    rows.forEach(function (d) { var v = f(d); if (!(v in seen)) { seen[v] = 1; out.push(v); } });
+    return out.sort(compare);
+  }
+  var byNumber = function (a, b) { return a - b; };
+  var vertices = document.getElementById('vertices');
+  var maxphonon = document.getElementById('maxphonon');
+  var degrees = document.getElementById('degrees');
+  options(vertices, distinct(function (d) { return d[5]; }, byNumber), function (v) { return v; });
+  options(maxphonon, distinct(maxDegree, byNumber), function (v) { return '≤ ' + v; });
+  options(degrees, distinct(function (d) { return d[6]; }), function (v) { return v || '(none)'; });
+
+  function materialize(k) {
+    var d = rows[shown[k]], cell = document.createElement('div');
+    cell.className = 'cell';
+    cell.style.left = (k % columns) * layout.width + 'px';
+    cell.style.top = Math.floor(k / columns) * layout.height + 'px';
+    cell.style.width = layout.width + 'px';
+    cell.style.height = layout.height + 'px';
+    cell.innerHTML = '<svg xmlns="http://www.w3.org/2000/svg" xmlns:xlink="http://www.w3.org/1999/xlink"' +
+      ' viewBox="0 0 ' + d[3] + ' ' + d[4] + '" style="height:' + layout.image + 'px">' +
+      blob.substr(d[1], d[2]) + '</svg><p>#' + d[0] + ' · ' + d[5] + ' vertices · [' + d[6] + ']</p>';
+    return cell;
+  }
+  function render() {
+    pending = false;
+    var first = Math.max(0, Math.floor(view.scrollTop / layout.height) - 2) * columns;
+    var last = Math.min(shown.length, (Math.ceil((view.scrollTop + view.clientHeight) / layout.height) + 2) * columns);
+    live.forEach(function (cell, k) {
+      if (k < first || k >= last) { space.removeChild(cell); live.delete(k); }
+    });
+    for (var k = first; k < last; ++k) {
+      if (!live.has(k)) { var cell = materialize(k); live.set(k, cell); space.appendChild(cell); }
+    }
+  }
+  function relayout() {
+    live.forEach(function (cell) { space.removeChild(cell); });
+    live.clear();
+    columns = Math.max(1, Math.floor(view.clientWidth / layout.width));
+    space.style.height = Math.ceil(shown.length / columns) * layout.height + 'px';
+    render();
+  }
+  function refilter() {
+    var v = vertices.value, m = maxphonon.value, s = degrees.value;
+    shown = [];
+    rows.forEach(function (d, i) {
+      if ((v === '' || d[5] == v) && (m === '' || maxDegree(d) <= m) && (s === '*' || d[6] === s)) shown.push(i);
+    });
+    document.getElementById('count').textContent = shown.length + ' of ' + rows.length + ' diagrams';
+    view.scrollTop = 0;
+    relayout();
+  }
+  [vertices, maxphonon, degrees].forEach(function (s) { s.addEventListener('change', refilter); });
+  view.addEventListener('scroll', function () {
+    if (!pending) { pending = true; requestAnimationFrame(render); }
+  });
+  window.addEventListener('resize', relayout);
+  refilter();
+})();
+</script>
+)";
+
+// Phonon lines per vertex, a tadpole counting twice like on the vertex label,
+// sorted in descending order.
+std::string phonon_degrees(const SimpleGraph& G) {
+    std::vector<int> degree(num_vertices(G), 0);
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        if (G[*er.first].style != LineStyle::Dashed) continue;
+        ++degree[source(*er.first, G)];
+        ++degree[target(*er.first, G)];
+    }
+    std::sort(degree.begin(), degree.end(), std::greater<int>());
+    std::string out;
+    for (int d : degree) {
+        if (d == 0) break;
+        if (!out.empty()) out += ',';
+        out += std::to_string(d);
+    }
+    return out;
+}
+
+} // namespace
+
+void GalleryWriter::add(const SimpleGraph& G, long long id) {
+    Entry entry;
+    std::string body = render_svg_body(G, symbols_, entry.width, entry.height);
+    // Line breaks only separate elements; the blob does without them.
+    body.erase(std::remove(body.begin(), body.end(), '\n'), body.end());
+    entry.id = id;
+    entry.offset = blob_.size();
+    entry.length = body.size();
+    entry.number_of_vertices = static_cast<int>(num_vertices(G));
+    entry.degrees = phonon_degrees(G);
+    blob_ += body;
+    entries_.push_back(std::move(entry));
+}
+
+void GalleryWriter::write(const std::string& path, const std::string& title) const {
+    // Uniform cells with the aspect ratio of the largest drawing, as on the
+    // contact sheet; each drawing is scaled to fit its cell, caption below.
+    const double cell_width = 260, caption = 22;
+    double width = 1, height = 0;
+    for (const auto& e : entries_) { width = std::max(width, e.width); height = std::max(height, e.height); }
+    const double image = cell_width * std::min(std::max(height / width, 0.25), 1.0);
+
+    std::ofstream f(path);
+    f << "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>" << title << "</title>\n"
+      << page_style << "</head>\n<body>\n"
+      << "<div id=\"bar\"><b>" << title << "</b>"
+      << "<label>vertices <select id=\"vertices\"><option value=\"\">all</option></select></label>"
+      << "<label>phonons per vertex <select id=\"maxphonon\"><option value=\"\">any</option></select></label>"
+      << "<label>degrees <select id=\"degrees\"><option value=\"*\">any</option></select></label>"
+      << "<span id=\"count\"></span></div>\n"
+      << "<div id=\"view\"><div id=\"space\"></div></div>\n"
+      << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"0\" height=\"0\" style=\"position:absolute\">\n"
+      << symbols_.defs() << "</svg>\n"
+      << "<script type=\"text/plain\" id=\"blob\">" << blob_ << "</script>\n"
+      << "<script type=\"application/json\" id=\"meta\">{\"cell\": {\"width\": " << fmt(cell_width)
+      << ", \"height\": " << fmt(image + caption + 10) << ", \"image\": " << fmt(image) << "}, \"diagrams\": [";
+    for (std::size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& e = entries_[i];
+        f << (i ? ",\n" : "\n") << "[" << e.id << "," << e.offset << "," << e.length << "," << fmt(e.width) << ","
+          << fmt(e.height) << "," << e.number_of_vertices << ",\"" << e.degrees << "\"]";
+    }
+    f << "]}</script>\n" << page_script << "</body>\n</html>\n";
+}
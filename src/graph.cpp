@@ -62,22 +62,33 @@ void add_styled_edges(SimpleGraph& G, const std::vector<SimpleGraph::vertex_desc
     }
 }
 
-std::string canonical_form(const SimpleGraph& G) {
+DiagramLines diagram_lines(const SimpleGraph& G) {
+    DiagramLines out;
+    out.vertices = static_cast<int>(num_vertices(G));
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        const auto e = *er.first;
+        out.lines.push_back({static_cast<int>(source(e, G)), static_cast<int>(target(e, G)),
+                             G[e].style == LineStyle::Solid ? 0 : 1});
+    }
+    return out;
+}
+
+namespace {
+void hash_combine(std::size_t& seed, std::size_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+}
+
+ColourRefinement refine_colours(const SimpleGraph& G) {
     const int V = static_cast<int>(num_vertices(G));
 
-    // Collect edges as (endpoint_a, endpoint_b, style) and build a colored
-    // incidence list. Each edge contributes to both endpoints (a self-loop
-    // therefore appears twice on its vertex, matching the degree counters).
-    std::vector<std::array<int, 3>> edge_list;
+    // Build a colored incidence list. Each edge contributes to both endpoints
+    // (a self-loop therefore appears twice on its vertex, matching the degree
+    // counters).
     std::vector<std::vector<std::pair<int, int>>> incidence(V); // (neighbor, style)
-    for (auto er = edges(G); er.first != er.second; ++er.first) {
-        const auto e = *er.first;
-        const int a = static_cast<int>(source(e, G));
-        const int b = static_cast<int>(target(e, G));
-        const int style = (G[e].style == LineStyle::Solid) ? 0 : 1;
-        edge_list.push_back({a, b, style});
-        incidence[a].push_back({b, style});
-        incidence[b].push_back({a, style});
+    for (const auto& e : diagram_lines(G).lines) {
+        incidence[e[0]].push_back({e[1], e[2]});
+        incidence[e[1]].push_back({e[0], e[2]});
     }
 
     // 1-WL colour refinement. The initial colour encodes (solid, dashed) degree;
@@ -97,7 +108,8 @@ std::string canonical_form(const SimpleGraph& G) {
         return static_cast<int>(rank.size());
     };
 
-    std::vector<int> color;
+    ColourRefinement refinement;
+    std::vector<int>& color = refinement.colour;
     {
         std::vector<std::vector<int>> base(V);
         for (int v = 0; v < V; ++v) base[v] = {G[v].solid_degree, G[v].dashed_degree};
@@ -105,14 +117,15 @@ std::string canonical_form(const SimpleGraph& G) {
     }
     int distinct = 0;
     for (int v = 0; v < V; ++v) distinct = std::max(distinct, color[v] + 1);
+    std::vector<std::vector<int>> sigs(V);
     while (true) {
-        std::vector<std::vector<int>> sigs(V);
         for (int v = 0; v < V; ++v) {
             std::vector<std::pair<int, int>> nb;
             nb.reserve(incidence[v].size());
             for (const auto& pr : incidence[v]) nb.push_back({color[pr.first], pr.second});
             std::sort(nb.begin(), nb.end());
             std::vector<int>& sig = sigs[v];
+            sig.clear();
             sig.reserve(1 + 2 * nb.size());
             sig.push_back(color[v]);
             for (const auto& pr : nb) { sig.push_back(pr.first); sig.push_back(pr.second); }
@@ -124,10 +137,34 @@ std::string canonical_form(const SimpleGraph& G) {
         distinct = new_distinct;
     }
 
+    // The invariant: vertex count, then each vertex's degrees and stable
+    // signature in colour order (vertices of one colour share both).
+    std::vector<int> by_colour(V);
+    for (int v = 0; v < V; ++v) by_colour[v] = v;
+    std::sort(by_colour.begin(), by_colour.end(), [&](int a, int b) { return color[a] < color[b]; });
+    refinement.invariant = static_cast<std::size_t>(V);
+    for (int v : by_colour) {
+        hash_combine(refinement.invariant, static_cast<std::size_t>(G[v].solid_degree));
+        hash_combine(refinement.invariant, static_cast<std::size_t>(G[v].dashed_degree));
+        for (int x : sigs[v]) hash_combine(refinement.invariant, static_cast<std::size_t>(x));
+    }
+    return refinement;
+}
+
+std::string canonical_form(const SimpleGraph& G, const ColourRefinement& refinement, long long* automorphisms) {
+    return canonical_form(diagram_lines(G), refinement, automorphisms);
+}
+
+std::string canonical_form(const DiagramLines& diagram, const ColourRefinement& refinement, long long* automorphisms) {
+    const int V = diagram.vertices;
+    const std::vector<std::array<int, 3>>& edge_list = diagram.lines;
+    const std::vector<int>& color = refinement.colour;
+
     // Group vertices into cells ordered by their stable colour. The canonical
     // labelling numbers vertices cell by cell; an isomorphism must respect cells,
     // so we only permute within each cell and keep the lexicographically smallest
-    // sorted edge list. Equal canonical strings <=> isomorphic graphs.
+    // sorted edge list. Equal canonical strings <=> isomorphic graphs, and the
+    // labellings reaching the smallest list differ by an automorphism.
     std::map<int, std::vector<int>> cell_map;
     for (int v = 0; v < V; ++v) cell_map[color[v]].push_back(v);
     std::vector<std::vector<int>> cells;
@@ -135,6 +172,7 @@ std::string canonical_form(const SimpleGraph& G) {
 
     std::vector<int> perm(V);
     std::string best;
+    long long best_count = 0;
     std::function<void(int, int)> search = [&](int ci, int base) {
         if (ci == static_cast<int>(cells.size())) {
             std::vector<std::array<int, 3>> relabeled;
@@ -154,7 +192,12 @@ std::string canonical_form(const SimpleGraph& G) {
                 key += std::to_string(e[2]);
                 key += ';';
             }
-            if (best.empty() || key < best) best = std::move(key);
+            if (best_count == 0 || key < best) {
+                best = std::move(key);
+                best_count = 1;
+            } else if (key == best) {
+                ++best_count;
+            }
             return;
         }
         std::vector<int> members = cells[ci];
@@ -168,9 +211,14 @@ std::string canonical_form(const SimpleGraph& G) {
     };
     search(0, 0);
 
+    if (automorphisms) *automorphisms = best_count;
     return std::to_string(V) + "#" + best;
 }
 
+std::string canonical_form(const SimpleGraph& G) {
+    return canonical_form(G, refine_colours(G));
+}
+
 namespace {
 // Can vertex a reach vertex b over all edges except the single edge `skip`?
 bool reaches_skipping_edge(const SimpleGraph& G, SimpleGraph::vertex_descriptor a,
@@ -193,6 +241,28 @@ bool reaches_skipping_edge(const SimpleGraph& G, SimpleGraph::vertex_descriptor
     }
     return visited.find(b) != visited.end();
 }
+
+// Vertices reachable from `start` over all edges except `skip_a` and `skip_b`.
+std::vector<bool> reachable_skipping_edges(const SimpleGraph& G, SimpleGraph::vertex_descriptor start,
+                                           SimpleGraph::edge_descriptor skip_a, SimpleGraph::edge_descriptor skip_b) {
+    std::vector<bool> visited(num_vertices(G), false);
+    std::stack<SimpleGraph::vertex_descriptor> s;
+    visited[start] = true;
+    s.push(start);
+    while (!s.empty()) {
+        auto u = s.top();
+        s.pop();
+        for (auto it = out_edges(u, G); it.first != it.second; ++it.first) {
+            if (*it.first == skip_a || *it.first == skip_b) continue;
+            auto v = target(*it.first, G);
+            if (!visited[v]) {
+                visited[v] = true;
+                s.push(v);
+            }
+        }
+    }
+    return visited;
+}
 }
 
 bool is_proper_diagram(const SimpleGraph& G) {
@@ -208,6 +278,30 @@ bool is_proper_diagram(const SimpleGraph& G) {
     return true;
 }
 
+bool is_skeleton_diagram(const SimpleGraph& G) {
+    // A self-energy insertion is a part of the diagram joined to the rest by
+    // exactly two electron lines and holding neither external vertex: cutting
+    // those two lines separates it from the initial and final vertices alike.
+    std::vector<SimpleGraph::edge_descriptor> lines;
+    SimpleGraph::vertex_descriptor initial = 0, final = 0;
+    for (auto vr = vertices(G); vr.first != vr.second; ++vr.first) {
+        if (G[*vr.first].initial) initial = *vr.first;
+        if (G[*vr.first].final) final = *vr.first;
+    }
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        if (G[*er.first].style == LineStyle::Solid && source(*er.first, G) != target(*er.first, G)) {
+            lines.push_back(*er.first);
+        }
+    }
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        for (std::size_t j = i + 1; j < lines.size(); ++j) {
+            auto reached = reachable_skipping_edges(G, initial, lines[i], lines[j]);
+            if (reached[final] && std::find(reached.begin(), reached.end(), false) != reached.end()) return false;
+        }
+    }
+    return true;
+}
+
 bool is_fully_connected(const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>& vertices) {
     auto reachable = dfs_reachable_vertices(G, vertices[0]);
     for (const auto& v : vertices) {
@@ -271,135 +365,3 @@ bool classify_and_validate_shape(SimpleGraph& G, const std::vector<SimpleGraph::
 
     return true;
 }
-
-void align_vertices(SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>& vertices, double x_length, double y_length) {
-    std::vector<SimpleGraph::vertex_descriptor> lower_vertices;
-    std::vector<SimpleGraph::vertex_descriptor> upper_vertices;
-
-    SimpleGraph::vertex_descriptor v_initial;
-    SimpleGraph::vertex_descriptor v_final;
-
-    bool initial_is_final = false;
-    // Search initial and final vertices
-    for (const auto& v : vertices) {
-        if (G[v].initial && !G[v].final) {
-            v_initial = v;
-            lower_vertices.push_back(v_initial);
-        }
-        if (G[v].final && !G[v].initial) {
-            v_final = v;
-        }
-
-        if (G[v].final && G[v].initial) {
-            initial_is_final = true;
-            v_initial = v;
-            v_final = v;
-            lower_vertices.push_back(v_initial);
-        }
-    }
-
-    // Perform DFS to find all vertices connected to vertices[0]
-    auto reachable_from_initial = dfs_reachable_vertices_solid(G, v_initial);
-
-    for (const auto& v : vertices) {
-        if (!G[v].initial && !G[v].final) {
-            if (reachable_from_initial.find(v) != reachable_from_initial.end()) {
-                lower_vertices.push_back(v);
-            } else {
-                upper_vertices.push_back(v);
-            }
-        }
-    }
-
-    // Add final vertex
-    if (!initial_is_final) {
-        lower_vertices.push_back(v_final);
-    }
-
-    // Align lower
-    if (lower_vertices.size() > 1) {
-        double dx_lower = x_length / (lower_vertices.size() - 1);
-        // Align
-        for (std::size_t i = 0; i < lower_vertices.size(); ++i) {
-            G[lower_vertices[i]].x = dx_lower * i;
-            G[lower_vertices[i]].y = 0.0;
-        }
-
-    } else {
-        G[lower_vertices[0]].x = 0.0;
-        G[lower_vertices[0]].y = 0.0;
-    }
-
-    // Align upper
-    if (upper_vertices.size() > 1) {
-        double dx_upper = x_length / (upper_vertices.size() - 1);
-        // Align
-        for (std::size_t i = 0; i < upper_vertices.size(); ++i) {
-            G[upper_vertices[i]].x = dx_upper * i;
-            G[upper_vertices[i]].y = y_length;
-        }
-    } else if (upper_vertices.size() == 1) {
-        G[upper_vertices[0]].x = 0.0;
-        G[upper_vertices[0]].y = y_length;
-    }
-
-    return;
-}
-
-void add_short_slanted_lines(SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>& vertices) {
-    double length = 0.3;
-    SimpleGraph::vertex_descriptor v_initial;
-    SimpleGraph::vertex_descriptor v_final;
-    double sign = 1.0;
-
-    for (const auto& v : vertices) {
-        if (G[v].initial && !G[v].final) {
-            v_initial = v;
-        }
-        if (G[v].final && !G[v].initial) {
-            v_final = v;
-        }
-
-        if (G[v].final && G[v].initial) {
-            v_initial = v;
-            v_final = v;
-        }
-    }
-
-    if (G[v_initial].x > G[v_final].x) {
-        sign = -1.0;
-    }
-
-    for (const auto& v : vertices) {
-        if (G[v].initial) {
-            // Add a dummy vertex
-            auto dummy = add_vertex(G);
-            // Position the dummy vertex slightly offset from the original vertex
-            G[dummy].x = G[v].x - sign * length; // Adjust as needed for desired slant length
-            G[dummy].y = G[v].y - length; // Adjust as needed for desired slant length
-            G[dummy].label = "";
-            G[dummy].size = 0.0;
-            G[dummy].fillcolor = "white";
-
-            // Add an edge between the original vertex and the dummy vertex
-            auto e = add_edge(dummy, v, G).first;
-            G[e].style = LineStyle::Solid;
-        }
-
-        if (G[v].final) {
-            // Add a dummy vertex
-            auto dummy = add_vertex(G);
-            // Position the dummy vertex slightly offset from the original vertex
-            G[dummy].x = G[v].x + sign * length; // Adjust as needed for desired slant length
-            G[dummy].y = G[v].y - length; // Adjust as needed for desired slant length
-            G[dummy].label = "";
-            G[dummy].size = 0.0;
-            G[dummy].fillcolor = "white";
-
-            // Add an edge between the original vertex and the dummy vertex
-            auto e = add_edge(v, dummy, G).first;
-            G[e].style = LineStyle::Solid;
-        }
-
-    }
-}
\ No newline at end of file
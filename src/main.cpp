@@ -2,40 +2,59 @@
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
-#include <unordered_set>
+#include <memory>
 #include "graph.hpp"
 #include "utility.hpp"
 #include "svg_writer.hpp"
+#include "filter.hpp"
+#include "enumeration.hpp"
+#include "rank.hpp"
+#include "dot_writer.hpp"
+#include "png_writer.hpp"
+#include "gallery_writer.hpp"
+#include "server.hpp"
+#include "evaluation.hpp"
+#include "composition.hpp"
+#include "verification.hpp"
+#include "sampling.hpp"
+#include <chrono>
+#include <map>
+#include <fstream>
 
 namespace {
-using EdgeList = std::vector<std::pair<int, int>>;
-
-// A solid-edge set can only yield a valid diagram if every vertex keeps an
-// electron degree <= 2 (the shape check rejects anything else outright), so we
-// drop over-degree sets before building a graph for them.
-bool solid_degrees_within_bound(const EdgeList& edges, int number_of_vertices) {
-    std::vector<int> degree(number_of_vertices, 0);
-    for (const auto& e : edges) {
-        if (++degree[e.first] > 2 || ++degree[e.second] > 2) {
-            return false;
-        }
+// Write diagram `id` as svg/graph_<id>.svg (and png/graph_<id>.png if asked)
+// and either dot/graph_<id>.dot or the next block of the run's multi-graph DOT
+// stream. Every writer draws the external legs itself, so G is shared between
+// them unchanged.
+void write_diagram(const SimpleGraph& G, long long id, bool compact_svg, bool png, DotStreamWriter* dot_stream) {
+    write_svg(G, "svg/graph_" + std::to_string(id) + ".svg", compact_svg);
+    if (png) {
+        write_png(G, "png/graph_" + std::to_string(id) + ".png");
+    }
+    if (dot_stream) {
+        dot_stream->add(G, id);
+    } else {
+        write_dot(G, "dot/graph_" + std::to_string(id) + ".dot");
     }
-    return true;
 }
 
-// A dashed-edge set can only yield a valid diagram if every vertex carries at
-// least one phonon line; dashed degree depends solely on the dashed edges, so
-// uncovered sets are always rejected and can be skipped early.
-bool dashed_covers_all_vertices(const EdgeList& edges, int number_of_vertices) {
-    std::vector<bool> covered(number_of_vertices, false);
-    for (const auto& e : edges) {
-        covered[e.first] = true;
-        covered[e.second] = true;
-    }
-    for (bool c : covered) {
-        if (!c) return false;
+// One block per diagram ("# diagram <id>", then "n omega_n Re Im" rows) and a
+// final block with their sum, separated by blank lines.
+void write_self_energy(const std::string& path, const HolsteinModel& model,
+                       const std::vector<std::vector<std::complex<double>>>& values) {
+    std::ofstream out(path);
+    out.precision(12);
+    std::vector<std::complex<double>> total(model.frequencies);
+    for (std::size_t id = 0; id <= values.size(); ++id) {
+        const bool is_total = id == values.size();
+        out << (is_total ? "# total" : "# diagram " + std::to_string(id)) << "\n";
+        for (int n = 0; n < model.frequencies; ++n) {
+            const std::complex<double> v = is_total ? total[n] : values[id][n];
+            if (!is_total) total[n] += v;
+            out << n << " " << (2 * n + 1) * M_PI / model.beta << " " << v.real() << " " << v.imag() << "\n";
+        }
+        out << "\n";
     }
-    return true;
 }
 }
 
@@ -43,6 +62,23 @@ int main(int argc, char* argv[]) {
     // argc: Number of command-line args
     // argv: Array of command-line args
 
+    // "serve [--socket PATH] [--threads N]" answers JSON-lines requests from
+    // warm in-memory catalogues instead of writing files (see server.hpp).
+    if (argc > 1 && std::strcmp(argv[1], "serve") == 0) {
+        ServerOptions server_options;
+        for (int i = 2; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+                server_options.socket_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                server_options.threads = std::atoi(argv[++i]);
+            } else {
+                std::cout << "Unknown serve option: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        return run_server(server_options);
+    }
+
     // Ensure the output directories exist
     std::filesystem::create_directories("dot");
     std::filesystem::create_directories("svg");
@@ -60,99 +96,271 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    // Limit of order
-    if (order > 4) {
-        std::cout << "Please specify the order as 1, 2, 3, or 4." << std::endl;
-        return 1;
-    }
-
     // By default only proper (1PI) self-energy diagrams are emitted; pass
     // "improper" (or "--improper") to also include the reducible ones.
-    bool include_improper = false;
+    // "compact" writes each SVG with shared wavy-line definitions, and "sheet"
+    // additionally collects every diagram into one contact sheet, svg/sheet.svg.
+    // "--filter EXPR" keeps only the diagrams matching EXPR (see filter.hpp).
+    // "dotstream" writes all diagrams to the single multi-graph file
+    // dot/graphs.dot instead of one .dot file each.
+    // "png" rasterizes each diagram in-process to png/graph_<id>.png.
+    // "gallery" also writes svg/gallery.html, one self-contained page that
+    // draws only the diagrams in view and filters them by vertex count and
+    // phonon degrees (see gallery_writer.hpp).
+    // "--id K" renders only diagram K of the run, located through a cached
+    // per-row count index (see rank.hpp) instead of enumerating ids 0..K-1.
+    // "--skeleton" keeps only skeleton diagrams (no self-energy insertion on
+    // any internal electron line) and reports the skeleton/non-skeleton
+    // breakdown of every order up to the requested one.
+    // "--evaluate MODEL" writes no pictures; it evaluates every diagram of the
+    // run on the Matsubara grid (see evaluation.hpp) into self_energy.dat.
+    // "--verify" writes no pictures either; it cross-checks the run against
+    // brute-force references (see verification.hpp), "--verify=K" on every
+    // K-th phonon row only, and dumps the smallest offending diagram of each
+    // failed check to verify/.
+    // "--sample K [--seed S]" writes no pictures; it draws K random diagrams
+    // of the run, uniformly over labelled diagrams (see sampling.hpp), into
+    // the DOT stream dot/samples.dot and their class keys and automorphism
+    // counts into samples.dat. It reaches orders up to 12. Candidates that
+    // fail the checks or the filter are redrawn, within a budget of 1000
+    // candidates per sample (at least 10^6); once 10^4 have been drawn, a run
+    // whose acceptance rate so far would overrun the budget stops early.
+    // "--stats" also reports how many candidate pairs the scan of a proper run
+    // handed to build_diagram and how many the candidate join skipped.
+    EnumerationOptions options;
+    options.order = order;
+    std::string filter_expression;
+    bool compact_svg = false;
+    bool contact_sheet = false;
+    bool dot_stream = false;
+    bool png = false;
+    bool gallery = false;
+    long long single_id = -1;
+    bool evaluate = false;
+    HolsteinModel model;
+    int verify_every = 0;
+    bool stats = false;
+    long long sample_count = 0;
+    unsigned long long seed = 1;
     for (int i = 2; i < argc; ++i) {
         if (std::strcmp(argv[i], "improper") == 0 || std::strcmp(argv[i], "--improper") == 0) {
-            include_improper = true;
+            options.include_improper = true;
+        } else if (std::strcmp(argv[i], "compact") == 0 || std::strcmp(argv[i], "--compact") == 0) {
+            compact_svg = true;
+        } else if (std::strcmp(argv[i], "sheet") == 0 || std::strcmp(argv[i], "--sheet") == 0) {
+            contact_sheet = true;
+        } else if (std::strcmp(argv[i], "dotstream") == 0 || std::strcmp(argv[i], "--dot-stream") == 0) {
+            dot_stream = true;
+        } else if (std::strcmp(argv[i], "png") == 0 || std::strcmp(argv[i], "--png") == 0) {
+            png = true;
+        } else if (std::strcmp(argv[i], "gallery") == 0 || std::strcmp(argv[i], "--gallery") == 0) {
+            gallery = true;
+        } else if (std::strcmp(argv[i], "--filter") == 0 || std::strncmp(argv[i], "--filter=", 9) == 0) {
+            filter_expression = argv[i][8] == '=' ? argv[i] + 9 : (i + 1 < argc ? argv[++i] : "");
+            std::string error;
+            if (!parse_filter(filter_expression, options.filter, error)) {
+                std::cout << "Invalid filter: " << error << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "skeleton") == 0 || std::strcmp(argv[i], "--skeleton") == 0) {
+            options.skeleton_only = true;
+        } else if (std::strcmp(argv[i], "--id") == 0 && i + 1 < argc) {
+            single_id = std::atoll(argv[++i]);
+        } else if (std::strcmp(argv[i], "--evaluate") == 0 || std::strncmp(argv[i], "--evaluate=", 11) == 0) {
+            const std::string model_expression = argv[i][10] == '=' ? argv[i] + 11 : (i + 1 < argc ? argv[++i] : "");
+            std::string error;
+            if (!parse_model(model_expression, model, error)) {
+                std::cout << "Invalid model: " << error << std::endl;
+                return 1;
+            }
+            evaluate = true;
+        } else if (std::strcmp(argv[i], "--verify") == 0 || std::strncmp(argv[i], "--verify=", 9) == 0) {
+            verify_every = argv[i][8] == '=' ? std::atoi(argv[i] + 9) : 1;
+            if (verify_every < 1) {
+                std::cout << "Invalid verification stride: " << argv[i] + 9 << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        } else if (std::strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+            sample_count = std::atoll(argv[++i]);
+            if (sample_count < 1) {
+                std::cout << "Invalid sample count: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
         }
     }
+    // Limit of order
+    if (sample_count > 0 ? order > 12 : order > 4) {
+        std::cout << (sample_count > 0 ? "Please specify an order from 1 to 12 for sampling."
+                                       : "Please specify the order as 1, 2, 3, or 4.")
+                  << std::endl;
+        return 1;
+    }
+    if (options.skeleton_only && options.include_improper) {
+        std::cout << "Skeleton diagrams are proper; drop \"improper\"." << std::endl;
+        return 1;
+    }
+    if (stats && options.include_improper) {
+        std::cout << "Improper runs are composed, not scanned; drop \"--stats\" or \"improper\"." << std::endl;
+        return 1;
+    }
+    SvgSheetWriter sheet;
+    GalleryWriter gallery_writer;
+    if (png) {
+        std::filesystem::create_directories("png");
+    }
 
-    int max_of_vertices = 2 * order;
-
-    // flag for ignoring diagrams with fermion-loop
-    bool ignore_fermion_loop = true;
+    if (single_id >= 0) {
+        const std::string index_path = "index/order_" + std::to_string(order) +
+                                       (options.include_improper ? "_improper" : "") +
+                                       (options.skeleton_only ? "_skeleton" : "") + ".idx";
+        DiagramIndex index = DiagramIndex::load_or_build(options, filter_expression, index_path);
+        SimpleGraph G;
+        std::vector<SimpleGraph::vertex_descriptor> vertices;
+        if (!index.unrank(single_id, G, vertices)) {
+            std::cout << "Diagram id " << single_id << " is out of range (this run has " << index.size()
+                      << " diagrams)." << std::endl;
+            return 1;
+        }
+        // The index is a cache on disk; a diagram that does not rank back to
+        // its id means it was written by a different enumeration.
+        if (index.rank(G) != single_id) {
+            std::cout << "Index " << index_path << " does not match this enumeration; delete it and retry."
+                      << std::endl;
+            return 1;
+        }
+        write_diagram(G, single_id, compact_svg, png, nullptr);
+        return 0;
+    }
 
-    // Canonical forms of the diagrams emitted so far. A candidate is a duplicate
-    // exactly when its canonical form is already present, so dedup is an O(1) hash
-    // lookup instead of a pairwise isomorphism scan, and only a short string is
-    // kept per diagram rather than the whole graph.
-    std::unordered_set<std::string> seen_canonical_forms;
+    if (verify_every > 0) {
+        const VerificationReport report = verify_run(options, verify_every);
+        std::cout << report.summary();
+        if (report.passed()) return 0;
+        std::filesystem::create_directories("verify");
+        report.write_mismatches("verify");
+        return 1;
+    }
 
-    for (int number_of_vertices = 1; number_of_vertices < max_of_vertices + 1; ++number_of_vertices) {
-        // Create all possible edges
-        EdgeList all_edges;
-        for (int i = 0; i < number_of_vertices; ++i) {
-            for (int j = i; j < number_of_vertices; ++j) {
-                all_edges.push_back({i, j});
+    if (sample_count > 0) {
+        // One "<sample> <vertices> <automorphisms> <key>" row per draw; weight
+        // a sample by automorphisms / vertices! for class-uniform estimates.
+        std::filesystem::create_directories("dot");
+        DotStreamWriter samples_dot("dot/samples.dot");
+        std::ofstream table("samples.dat");
+        table << "# sample vertices automorphisms canonical_form\n";
+        DiagramSampler sampler(options, seed);
+        const auto start = std::chrono::steady_clock::now();
+        SimpleGraph G;
+        std::vector<SimpleGraph::vertex_descriptor> vertices;
+        const long long budget = std::max(1000000LL, 1000 * sample_count), pilot = 10000;
+        // Candidates the remaining samples need at the acceptance rate so far;
+        // with nothing accepted yet, at least the candidates spent already.
+        auto projected = [&](long long remaining) {
+            const long long attempts = sampler.attempts(), accepted = std::max(1LL, sampler.accepted());
+            return attempts + static_cast<long long>(static_cast<double>(remaining) * attempts / accepted);
+        };
+        for (long long i = 0; i < sample_count; ++i) {
+            bool drawn = false;
+            while (!drawn && sampler.attempts() < budget) {
+                // Draw in pilot-sized slices so that a filter this run can
+                // hardly ever satisfy is rejected early.
+                const long long before = sampler.attempts();
+                drawn = sampler.next(G, vertices, std::min(pilot, budget - before));
+                if (sampler.attempts() == before) break; // the run has no candidates
+                if (sampler.attempts() >= pilot && projected(sample_count - i - (drawn ? 1 : 0)) > budget) {
+                    std::cout << sampler.accepted() << " of " << sampler.attempts()
+                              << " candidates were accepted; " << sample_count
+                              << " samples would need more than the budget of " << budget
+                              << " candidates. Loosen the filter or draw fewer samples." << std::endl;
+                    return 1;
+                }
             }
-        }
-
-        // Pre-filter the edge sets once per vertex count, keeping only those that
-        // can still produce a valid diagram (preserving enumeration order so the
-        // surviving candidate sequence is a subsequence of the brute-force one).
-        std::vector<EdgeList> dashed_combinations;
-        enumerate_combinations(all_edges, order, [&](const EdgeList& combo) {
-            if (dashed_covers_all_vertices(combo, number_of_vertices)) {
-                dashed_combinations.push_back(combo);
+            if (!drawn) {
+                std::cout << "No diagram of this run was drawn in " << sampler.attempts() << " candidates."
+                          << std::endl;
+                return 1;
             }
-        });
+            long long automorphisms = 0;
+            const std::string key = canonical_form(G, refine_colours(G), &automorphisms);
+            table << i << " " << num_vertices(G) << " " << automorphisms << " " << key << "\n";
+            samples_dot.add(G, i);
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << sample_count << " samples from " << sampler.attempts() << " candidates in " << seconds
+                  << " s" << std::endl;
+        return 0;
+    }
 
-        std::vector<EdgeList> solid_combinations;
-        enumerate_combinations(all_edges, number_of_vertices - 1, [&](const EdgeList& combo) {
-            if (solid_degrees_within_bound(combo, number_of_vertices)) {
-                solid_combinations.push_back(combo);
+    if (evaluate) {
+        std::vector<CompiledDiagram> compiled;
+        long long failed = 0;
+        enumerate_diagrams(options, [&](const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>&,
+                                        const CanonicalKey&) {
+            CompiledDiagram d;
+            if (compile_diagram(G, d)) {
+                compiled.push_back(d);
+            } else {
+                std::cout << "Diagram " << compiled.size() + failed << " needs more than "
+                          << max_internal_frequencies << " internal frequencies." << std::endl;
+                ++failed;
             }
         });
+        if (failed) return 1;
+        write_self_energy("self_energy.dat", model, evaluate_diagrams(compiled, model));
+        return 0;
+    }
 
-        for (const auto& dashed_edges : dashed_combinations) {
-            for (const auto& solid_edges : solid_combinations) {
-                // Initialize graph
-                SimpleGraph G;
-                std::vector<SimpleGraph::vertex_descriptor> vertices;
-                std::tie(G, vertices) = get_initial_graph_and_vertices(number_of_vertices);
-
-                // Add phonon (dashed) and electron (solid) edges
-                add_styled_edges(G, vertices, dashed_edges, /*dashed=*/true);
-                add_styled_edges(G, vertices, solid_edges, /*dashed=*/false);
-
-                // Keep only connected, well-shaped self-energy diagrams
-                if (!is_fully_connected(G, vertices)) {
-                    continue;
-                }
-                if (!classify_and_validate_shape(G, vertices, ignore_fermion_loop)) {
-                    continue;
-                }
+    std::unique_ptr<DotStreamWriter> dot_writer;
+    if (dot_stream) dot_writer = std::make_unique<DotStreamWriter>("dot/graphs.dot");
 
-                // By default keep only proper (1PI) diagrams
-                if (!include_improper && !is_proper_diagram(G)) {
-                    continue;
-                }
+    const DiagramVisitor write = [&](const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>&,
+                                     const CanonicalKey&) {
+        int id = file_counter++;
+        if (contact_sheet) sheet.add(G);
+        if (gallery) gallery_writer.add(G, id);
+        write_diagram(G, id, compact_svg, png, dot_writer.get());
+    };
+    if (stats) {
+        ScanStats scan;
+        scan_diagrams(options, write, &scan);
+        std::cout << "candidate pairs: " << scan.pairs << ", joined: " << scan.joined << ", avoided: "
+                  << scan.pairs - scan.joined << std::endl;
+    } else {
+        enumerate_diagrams(options, write);
+    }
 
-                // Labeling: show each vertex's phonon-line count
-                for (const auto& v : vertices) {
-                    G[v].label = std::to_string(G[v].dashed_degree);
-                }
+    if (contact_sheet) {
+        sheet.write("svg/sheet.svg");
+    }
+    if (gallery) {
+        gallery_writer.write("svg/gallery.html", "Order " + std::to_string(order) +
+                                                     (options.skeleton_only ? " skeleton"
+                                                      : options.include_improper ? " proper and improper"
+                                                                                 : " proper") +
+                                                     " self-energy diagrams");
+    }
 
-                // Deduplicate by canonical form (O(1) hash lookup)
-                if (seen_canonical_forms.insert(canonical_form(G)).second) {
-                    int id = file_counter++;
-                    // The SVG renderer lays out the diagram itself (electron
-                    // backbone, phonon arcs), so render before the dot-only dummies.
-                    write_svg(G, "svg/graph_" + std::to_string(id) + ".svg");
-                    // Add short slanted lines to initial and final vertices (dot)
-                    add_short_slanted_lines(G, vertices);
-                    std::ofstream file("dot/graph_" + std::to_string(id) + ".dot");
-                    boost::write_graphviz(file, G, vertex_writer(G), edge_writer(G), graph_writer());
-                }
-            }
+    if (options.skeleton_only) {
+        // Lower-order skeletons are counted by a scan, non-skeletons by
+        // inserting self-energies into them; catalogues are shared between
+        // orders.
+        std::map<std::string, std::shared_ptr<const std::vector<SimpleGraph>>> cache;
+        auto catalogue = [&](const EnumerationOptions& o) {
+            auto& entry = cache[catalogue_key(o)];
+            if (!entry) entry = enumerate_catalogue(o);
+            return entry;
+        };
+        for (int k = 1; k <= order; ++k) {
+            EnumerationOptions at_order = options;
+            at_order.order = k;
+            const long long skeletons = k == order ? file_counter : static_cast<long long>(catalogue(at_order)->size());
+            const long long others = count_non_skeleton_diagrams(at_order, catalogue);
+            std::cout << "order " << k << ": " << skeletons << " skeleton, " << others << " non-skeleton, "
+                      << skeletons + others << " proper" << std::endl;
         }
     }
 
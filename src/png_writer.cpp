@@ -0,0 +1,401 @@
+#include "png_writer.hpp"
+#include "drawing.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct Rgb { std::uint8_t r, g, b; };
+
+Rgb named_colour(const std::string& name) {
+    if (name == "red") return {255, 0, 0};
+    if (name == "blue") return {0, 0, 255};
+    if (name == "black") return {0, 0, 0};
+    return {255, 255, 255};
+}
+
+// --- rasterizer ---
+// Each shape is first accumulated into a coverage mask (taking the maximum,
+// so the joints of a polyline are not blended twice) over its bounding box,
+// then composited onto the RGB image in one pass.
+class Raster {
+public:
+    Raster(int width, int height)
+        : width_(width), height_(height), rgb_(3 * width * height, 255), coverage_(width * height, 0.0f) {}
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    const std::vector<std::uint8_t>& pixels() const { return rgb_; }
+
+    // Thick segment with round ends: coverage falls off over one pixel across
+    // the stroke boundary.
+    void stroke_segment(Vec a, Vec b, double half_width) {
+        const double pad = half_width + 1.0;
+        Vec d = b - a;
+        const double dd = d.x * d.x + d.y * d.y;
+        for_pixels(std::min(a.x, b.x) - pad, std::min(a.y, b.y) - pad, std::max(a.x, b.x) + pad,
+                   std::max(a.y, b.y) + pad, [&](double x, double y) {
+            double t = dd > 0 ? ((x - a.x) * d.x + (y - a.y) * d.y) / dd : 0.0;
+            t = std::clamp(t, 0.0, 1.0);
+            double ex = x - (a.x + d.x * t), ey = y - (a.y + d.y * t);
+            return half_width + 0.5 - std::sqrt(ex * ex + ey * ey);
+        });
+    }
+
+    void stroke_polyline(const std::vector<Vec>& pts, bool closed, double half_width) {
+        for (std::size_t i = 1; i < pts.size(); ++i) stroke_segment(pts[i - 1], pts[i], half_width);
+        if (closed && pts.size() > 2) stroke_segment(pts.back(), pts.front(), half_width);
+    }
+
+    void fill_disc(Vec c, double r) {
+        for_pixels(c.x - r - 1, c.y - r - 1, c.x + r + 1, c.y + r + 1, [&](double x, double y) {
+            return r + 0.5 - std::hypot(x - c.x, y - c.y);
+        });
+    }
+
+    void stroke_circle(Vec c, double r, double half_width) {
+        const double pad = r + half_width + 1;
+        for_pixels(c.x - pad, c.y - pad, c.x + pad, c.y + pad, [&](double x, double y) {
+            return half_width + 0.5 - std::abs(std::hypot(x - c.x, y - c.y) - r);
+        });
+    }
+
+    // Scanline fill of a triangle, 4x4 supersampled per pixel.
+    void fill_triangle(Vec a, Vec b, Vec c) {
+        auto edge = [](Vec p, Vec q, double x, double y) { return (q.x - p.x) * (y - p.y) - (q.y - p.y) * (x - p.x); };
+        const double area = edge(a, b, c.x, c.y);
+        if (area == 0) return;
+        int x0, y0, x1, y1;
+        if (!clip(std::min({a.x, b.x, c.x}), std::min({a.y, b.y, c.y}), std::max({a.x, b.x, c.x}),
+                  std::max({a.y, b.y, c.y}), x0, y0, x1, y1)) return;
+        for (int py = y0; py <= y1; ++py) {
+            for (int px = x0; px <= x1; ++px) {
+                int inside = 0;
+                for (int sy = 0; sy < 4; ++sy) {
+                    for (int sx = 0; sx < 4; ++sx) {
+                        double x = px + (sx + 0.5) / 4, y = py + (sy + 0.5) / 4;
+                        double w0 = edge(b, c, x, y) / area, w1 = edge(c, a, x, y) / area, w2 = edge(a, b, x, y) / area;
+                        if (w0 >= 0 && w1 >= 0 && w2 >= 0) ++inside;
+                    }
+                }
+                float& cov = coverage_[py * width_ + px];
+                cov = std::max(cov, inside / 16.0f);
+            }
+        }
+    }
+
+    // Blend the accumulated mask onto the image in `colour` and clear it.
+    void composite(Rgb colour) {
+        if (dirty_x0_ > dirty_x1_) return;
+        for (int y = dirty_y0_; y <= dirty_y1_; ++y) {
+            for (int x = dirty_x0_; x <= dirty_x1_; ++x) {
+                float& cov = coverage_[y * width_ + x];
+                if (cov <= 0) continue;
+                std::uint8_t* p = &rgb_[3 * (y * width_ + x)];
+                const float c = std::min(cov, 1.0f);
+                p[0] = static_cast<std::uint8_t>(std::lround(p[0] + (colour.r - p[0]) * c));
+                p[1] = static_cast<std::uint8_t>(std::lround(p[1] + (colour.g - p[1]) * c));
+                p[2] = static_cast<std::uint8_t>(std::lround(p[2] + (colour.b - p[2]) * c));
+                cov = 0;
+            }
+        }
+        dirty_x0_ = dirty_y0_ = INT32_MAX;
+        dirty_x1_ = dirty_y1_ = -1;
+    }
+
+private:
+    bool clip(double fx0, double fy0, double fx1, double fy1, int& x0, int& y0, int& x1, int& y1) {
+        x0 = std::max(0, (int)std::floor(fx0));
+        y0 = std::max(0, (int)std::floor(fy0));
+        x1 = std::min(width_ - 1, (int)std::ceil(fx1));
+        y1 = std::min(height_ - 1, (int)std::ceil(fy1));
+        if (x0 > x1 || y0 > y1) return false;
+        dirty_x0_ = std::min(dirty_x0_, x0);
+        dirty_y0_ = std::min(dirty_y0_, y0);
+        dirty_x1_ = std::max(dirty_x1_, x1);
+        dirty_y1_ = std::max(dirty_y1_, y1);
+        return true;
+    }
+
+    // Evaluate `signed_coverage` at each pixel centre of the box and keep the
+    // largest clamped value in the mask.
+    template <typename F>
+    void for_pixels(double fx0, double fy0, double fx1, double fy1, F signed_coverage) {
+        int x0, y0, x1, y1;
+        if (!clip(fx0, fy0, fx1, fy1, x0, y0, x1, y1)) return;
+        for (int py = y0; py <= y1; ++py) {
+            for (int px = x0; px <= x1; ++px) {
+                double c = signed_coverage(px + 0.5, py + 0.5);
+                if (c <= 0) continue;
+                float& cov = coverage_[py * width_ + px];
+                cov = std::max(cov, static_cast<float>(std::min(c, 1.0)));
+            }
+        }
+    }
+
+    int width_, height_;
+    std::vector<std::uint8_t> rgb_;
+    std::vector<float> coverage_;
+    int dirty_x0_ = INT32_MAX, dirty_y0_ = INT32_MAX, dirty_x1_ = -1, dirty_y1_ = -1;
+};
+
+// Stroke font for vertex labels: digits on a 4 x 6 grid, y down from the top.
+const std::vector<std::vector<std::array<double, 2>>>& digit_glyph(char c) {
+    static const std::map<char, std::vector<std::vector<std::array<double, 2>>>> glyphs = {
+        {'0', {{{1, 0}, {3, 0}, {4, 1}, {4, 5}, {3, 6}, {1, 6}, {0, 5}, {0, 1}, {1, 0}}}},
+        {'1', {{{1, 1}, {2, 0}, {2, 6}}, {{1, 6}, {3, 6}}}},
+        {'2', {{{0, 1}, {1, 0}, {3, 0}, {4, 1}, {4, 2}, {0, 6}, {4, 6}}}},
+        {'3', {{{0, 0}, {4, 0}, {2, 2.5}, {3, 2.5}, {4, 3.5}, {4, 5}, {3, 6}, {1, 6}, {0, 5}}}},
+        {'4', {{{3, 6}, {3, 0}, {0, 4}, {4, 4}}}},
+        {'5', {{{4, 0}, {0, 0}, {0, 2.5}, {3, 2.5}, {4, 3.5}, {4, 5}, {3, 6}, {0, 6}}}},
+        {'6', {{{3, 0}, {1, 0}, {0, 1}, {0, 5}, {1, 6}, {3, 6}, {4, 5}, {4, 3.5}, {3, 2.5}, {0, 2.5}}}},
+        {'7', {{{0, 0}, {4, 0}, {1.5, 6}}}},
+        {'8', {{{1, 0}, {3, 0}, {4, 1}, {4, 2}, {3, 3}, {1, 3}, {0, 2}, {0, 1}, {1, 0}},
+               {{1, 3}, {3, 3}, {4, 4}, {4, 5}, {3, 6}, {1, 6}, {0, 5}, {0, 4}, {1, 3}}}},
+        {'9', {{{4, 3.5}, {1, 3.5}, {0, 2.5}, {0, 1}, {1, 0}, {3, 0}, {4, 1}, {4, 5}, {3, 6}, {1, 6}}}},
+    };
+    static const std::vector<std::vector<std::array<double, 2>>> none;
+    auto it = glyphs.find(c);
+    return it == glyphs.end() ? none : it->second;
+}
+
+// Draws the primitives into a Raster at one pixel per SVG unit.
+class RasterSink : public DiagramSink {
+public:
+    std::unique_ptr<Raster> raster;
+
+    void canvas(double width, double height) override {
+        raster = std::make_unique<Raster>((int)std::ceil(width), (int)std::ceil(height));
+    }
+    void line(Vec a, Vec b) override {
+        raster->stroke_segment(a, b, line_width / 2);
+        raster->composite({0, 0, 0});
+    }
+    void curve(const std::string& id, Vec origin, bool closed, const CurveSampler& sample) override {
+        auto it = shapes_.find(id);
+        if (it == shapes_.end()) it = shapes_.emplace(id, sample(origin)).first;
+        std::vector<Vec> pts;
+        pts.reserve(it->second.size());
+        for (const auto& p : it->second) pts.push_back(p + origin);
+        raster->stroke_polyline(pts, closed, line_width / 2);
+        raster->composite({0, 0, 0});
+    }
+    void arrowhead(Vec tip, Vec b1, Vec b2) override {
+        raster->fill_triangle(tip, b1, b2);
+        raster->composite({0, 0, 0});
+    }
+    void vertex(Vec p, double r, const std::string& fill, const std::string& label,
+                const std::string& label_colour) override {
+        raster->fill_disc(p, r);
+        raster->composite(named_colour(fill));
+        raster->stroke_circle(p, r, vertex_stroke_width / 2);
+        raster->composite({0, 0, 0});
+        if (label.empty()) return;
+        // Glyphs about the size of 13px sans-serif digits, centred like the
+        // SVG text (baseline 4px below the centre).
+        const double scale = 1.55, advance = 7.2;
+        double x = p.x - advance * label.size() / 2 + (advance - 4 * scale) / 2;
+        const double top = p.y + 4 - 6 * scale;
+        for (char c : label) {
+            for (const auto& stroke : digit_glyph(c)) {
+                std::vector<Vec> pts;
+                for (const auto& q : stroke) pts.push_back({x + q[0] * scale, top + q[1] * scale});
+                raster->stroke_polyline(pts, false, 0.7);
+            }
+            x += advance;
+        }
+        raster->composite(named_colour(label_colour));
+    }
+
+private:
+    std::map<std::string, std::vector<Vec>> shapes_; // sampled once per shape id
+};
+
+// --- PNG encoding ---
+
+std::uint32_t crc32(const std::uint8_t* data, std::size_t n, std::uint32_t crc = 0) {
+    static const auto table = [] {
+        std::array<std::uint32_t, 256> t{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (std::size_t i = 0; i < n; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+std::uint32_t adler32(const std::vector<std::uint8_t>& data) {
+    std::uint32_t a = 1, b = 0;
+    for (std::uint8_t byte : data) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<std::uint8_t>& out) : out_(out) {}
+    // Value bits, least significant first (deflate's order for extra bits).
+    void bits(std::uint32_t value, int count) {
+        acc_ |= value << n_;
+        n_ += count;
+        while (n_ >= 8) { out_.push_back(acc_ & 0xFF); acc_ >>= 8; n_ -= 8; }
+    }
+    // Huffman codes are defined most significant bit first.
+    void code(std::uint32_t value, int count) {
+        std::uint32_t reversed = 0;
+        for (int i = 0; i < count; ++i) reversed |= ((value >> i) & 1) << (count - 1 - i);
+        bits(reversed, count);
+    }
+    void flush() { if (n_ > 0) { out_.push_back(acc_ & 0xFF); acc_ = 0; n_ = 0; } }
+private:
+    std::vector<std::uint8_t>& out_;
+    std::uint32_t acc_ = 0;
+    int n_ = 0;
+};
+
+void put_literal(BitWriter& w, int symbol) {
+    if (symbol < 144) w.code(0x30 + symbol, 8);
+    else if (symbol < 256) w.code(0x190 + symbol - 144, 9);
+    else if (symbol < 280) w.code(symbol - 256, 7);
+    else w.code(0xC0 + symbol - 280, 8);
+}
+
+void put_match(BitWriter& w, int length, int distance) {
+    static const int length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27,
+                                        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                         2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                      193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                      6145, 8193, 12289, 16385, 24577};
+    static const int dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                       6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    int l = 28;
+    while (length_base[l] > length) --l;
+    put_literal(w, 257 + l);
+    w.bits(length - length_base[l], length_extra[l]);
+    int d = 29;
+    while (dist_base[d] > distance) --d;
+    w.code(d, 5);
+    w.bits(distance - dist_base[d], dist_extra[d]);
+}
+
+// zlib stream holding one fixed-Huffman deflate block, with greedy LZ77
+// matching over a 32 KiB window (hash chains on 3-byte prefixes).
+std::vector<std::uint8_t> zlib_compress(const std::vector<std::uint8_t>& data) {
+    std::vector<std::uint8_t> out = {0x78, 0x01};
+    BitWriter w(out);
+    w.bits(1, 1); // final block
+    w.bits(1, 2); // fixed Huffman codes
+
+    const int window = 32768, max_chain = 32, n = static_cast<int>(data.size());
+    std::vector<int> head(1 << 15, -1), prev(n, -1);
+    auto hash = [&](int i) { return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & 0x7FFF; };
+    auto insert = [&](int i) {
+        if (i + 2 >= n) return;
+        int h = hash(i);
+        prev[i] = head[h];
+        head[h] = i;
+    };
+    int i = 0;
+    while (i < n) {
+        int best_len = 0, best_dist = 0;
+        if (i + 2 < n) {
+            int candidate = head[hash(i)];
+            for (int chain = 0; candidate >= 0 && i - candidate <= window && chain < max_chain; ++chain) {
+                int len = 0;
+                while (len < 258 && i + len < n && data[candidate + len] == data[i + len]) ++len;
+                if (len > best_len) { best_len = len; best_dist = i - candidate; }
+                if (len == 258) break;
+                candidate = prev[candidate];
+            }
+        }
+        if (best_len >= 3) {
+            put_match(w, best_len, best_dist);
+            for (int k = 0; k < best_len; ++k) insert(i + k);
+            i += best_len;
+        } else {
+            put_literal(w, data[i]);
+            insert(i);
+            ++i;
+        }
+    }
+    put_literal(w, 256); // end of block
+    w.flush();
+    std::uint32_t adler = adler32(data);
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back((adler >> shift) & 0xFF);
+    return out;
+}
+
+// Scanlines with a per-row filter byte: None, Sub or Up, whichever leaves the
+// smallest sum of absolute residuals (the usual PNG heuristic).
+std::vector<std::uint8_t> filter_scanlines(const Raster& raster) {
+    const int stride = 3 * raster.width();
+    const auto& px = raster.pixels();
+    std::vector<std::uint8_t> out;
+    out.reserve((stride + 1) * raster.height());
+    std::vector<std::uint8_t> row[3];
+    for (int y = 0; y < raster.height(); ++y) {
+        const std::uint8_t* cur = &px[y * stride];
+        const std::uint8_t* up = y > 0 ? &px[(y - 1) * stride] : nullptr;
+        long best_cost = -1;
+        int best = 0;
+        for (int f = 0; f < 3; ++f) {
+            row[f].resize(stride);
+            long cost = 0;
+            for (int x = 0; x < stride; ++x) {
+                std::uint8_t pred = f == 1 ? (x >= 3 ? cur[x - 3] : 0) : f == 2 ? (up ? up[x] : 0) : 0;
+                row[f][x] = static_cast<std::uint8_t>(cur[x] - pred);
+                cost += std::abs(static_cast<std::int8_t>(row[f][x]));
+            }
+            if (best_cost < 0 || cost < best_cost) { best_cost = cost; best = f; }
+        }
+        out.push_back(static_cast<std::uint8_t>(best));
+        out.insert(out.end(), row[best].begin(), row[best].end());
+    }
+    return out;
+}
+
+void put_chunk(std::ofstream& f, const char* type, const std::vector<std::uint8_t>& data) {
+    std::vector<std::uint8_t> buf;
+    const std::uint32_t n = static_cast<std::uint32_t>(data.size());
+    for (int shift = 24; shift >= 0; shift -= 8) buf.push_back((n >> shift) & 0xFF);
+    buf.insert(buf.end(), type, type + 4);
+    buf.insert(buf.end(), data.begin(), data.end());
+    const std::uint32_t crc = crc32(buf.data() + 4, buf.size() - 4);
+    for (int shift = 24; shift >= 0; shift -= 8) buf.push_back((crc >> shift) & 0xFF);
+    f.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+}
+
+} // namespace
+
+void write_png(const SimpleGraph& G, const std::string& path) {
+    RasterSink sink;
+    draw_diagram(G, sink);
+    const Raster& raster = *sink.raster;
+
+    std::vector<std::uint8_t> header;
+    for (std::uint32_t v : {static_cast<std::uint32_t>(raster.width()), static_cast<std::uint32_t>(raster.height())})
+        for (int shift = 24; shift >= 0; shift -= 8) header.push_back((v >> shift) & 0xFF);
+    header.insert(header.end(), {8, 2, 0, 0, 0}); // 8-bit RGB, deflate, adaptive filters, no interlace
+
+    std::ofstream f(path, std::ios::binary);
+    static const std::uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    f.write(reinterpret_cast<const char*>(signature), 8);
+    put_chunk(f, "IHDR", header);
+    put_chunk(f, "IDAT", zlib_compress(filter_scanlines(raster)));
+    put_chunk(f, "IEND", {});
+}
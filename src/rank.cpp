@@ -0,0 +1,190 @@
+#include "rank.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+
+namespace {
+const char* const index_magic = "feynman-diagram-index 2";
+
+// The edge list after renaming vertex v to perm[v], as a sorted list of
+// (smaller, larger) pairs -- the form in which it would be enumerated.
+EdgeList relabel(const EdgeList& edges, const std::vector<int>& perm) {
+    EdgeList out;
+    out.reserve(edges.size());
+    for (const auto& e : edges) {
+        int a = perm[e.first], b = perm[e.second];
+        out.push_back({std::min(a, b), std::max(a, b)});
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// The automorphisms of a phonon edge list, or none at all if some relabelling
+// makes it lexicographically smaller (such a row introduces no diagram).
+std::vector<std::vector<int>> automorphisms_if_minimal(const EdgeList& dashed, int number_of_vertices) {
+    std::vector<std::vector<int>> autos;
+    std::vector<int> perm(number_of_vertices);
+    std::iota(perm.begin(), perm.end(), 0);
+    do {
+        EdgeList image = relabel(dashed, perm);
+        if (image < dashed) return {};
+        if (image == dashed) autos.push_back(perm);
+    } while (std::next_permutation(perm.begin(), perm.end()));
+    return autos;
+}
+
+// True if no automorphism of the phonon edges maps `solid` to a smaller list.
+bool solid_is_orbit_minimum(const EdgeList& solid, const std::vector<std::vector<int>>& autos) {
+    for (const auto& perm : autos) {
+        if (relabel(solid, perm) < solid) return false;
+    }
+    return true;
+}
+
+void split_edges(const SimpleGraph& G, EdgeList& dashed, EdgeList& solid) {
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        int a = static_cast<int>(source(*er.first, G)), b = static_cast<int>(target(*er.first, G));
+        (G[*er.first].style == LineStyle::Dashed ? dashed : solid).push_back({std::min(a, b), std::max(a, b)});
+    }
+}
+
+bool read_index(const std::string& path, const EnumerationOptions& options, const std::string& filter_expression,
+                std::vector<std::tuple<int, int, long long>>& counts) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string magic, flags, filter;
+    std::getline(in, magic);
+    std::getline(in, flags);
+    std::getline(in, filter);
+    std::ostringstream expected;
+    expected << "order " << options.order << " improper " << options.include_improper << " skeleton "
+             << options.skeleton_only;
+    if (magic != index_magic || flags != expected.str() || filter != "filter " + filter_expression) return false;
+    int number_of_vertices, row;
+    long long count;
+    while (in >> number_of_vertices >> row >> count) counts.emplace_back(number_of_vertices, row, count);
+    return in.eof();
+}
+}
+
+DiagramIndex DiagramIndex::load_or_build(const EnumerationOptions& options, const std::string& filter_expression,
+                                         const std::string& path) {
+    DiagramIndex index;
+    index.options_ = options;
+
+    std::vector<std::tuple<int, int, long long>> counts;
+    if (!read_index(path, options, filter_expression, counts)) {
+        // One full enumeration, counting the first occurrences in each row.
+        counts.clear();
+        DiagramDeduplicator seen;
+        for (int number_of_vertices = 1; number_of_vertices <= 2 * options.order; ++number_of_vertices) {
+            if (!options.filter.accepts_vertex_count(number_of_vertices)) continue;
+            const CandidateJoin join(options, number_of_vertices);
+            EdgeList dashed_edges, solid_edges;
+            std::vector<std::size_t> partners;
+            for (std::size_t row = 0; row < join.dashed().size(); ++row) {
+                join.dashed().decode(row, dashed_edges);
+                join.partners(dashed_edges, partners);
+                long long count = 0;
+                for (std::size_t s : partners) {
+                    join.solid().decode(s, solid_edges);
+                    SimpleGraph G;
+                    std::vector<SimpleGraph::vertex_descriptor> vertices;
+                    if (build_diagram(options, number_of_vertices, dashed_edges, solid_edges, G, vertices) &&
+                        seen.insert(G)) {
+                        ++count;
+                    }
+                }
+                if (count > 0) counts.emplace_back(number_of_vertices, static_cast<int>(row), count);
+            }
+        }
+
+        std::filesystem::path p(path);
+        if (p.has_parent_path()) std::filesystem::create_directories(p.parent_path());
+        std::ofstream out(path);
+        out << index_magic << "\n"
+            << "order " << options.order << " improper " << options.include_improper << " skeleton "
+            << options.skeleton_only << "\n"
+            << "filter " << filter_expression << "\n";
+        for (const auto& c : counts) out << std::get<0>(c) << " " << std::get<1>(c) << " " << std::get<2>(c) << "\n";
+    }
+
+    for (const auto& c : counts) {
+        index.rows_.push_back({std::get<0>(c), std::get<1>(c), index.total_, std::get<2>(c)});
+        index.total_ += std::get<2>(c);
+    }
+    return index;
+}
+
+bool DiagramIndex::unrank(long long k, SimpleGraph& G, std::vector<SimpleGraph::vertex_descriptor>& vertices) const {
+    if (k < 0 || k >= total_) return false;
+    auto it = std::upper_bound(rows_.begin(), rows_.end(), k,
+                               [](long long id, const Row& r) { return id < r.first_id; });
+    const Row& r = *(it - 1);
+
+    const CandidateJoin join(options_, r.number_of_vertices);
+    const EdgeList dashed_edges = join.dashed()[r.row];
+    const auto autos = automorphisms_if_minimal(dashed_edges, r.number_of_vertices);
+    long long remaining = k - r.first_id;
+    std::vector<std::size_t> partners;
+    join.partners(dashed_edges, partners);
+    EdgeList solid_edges;
+    for (std::size_t s : partners) {
+        join.solid().decode(s, solid_edges);
+        if (!solid_is_orbit_minimum(solid_edges, autos)) continue;
+        if (!build_diagram(options_, r.number_of_vertices, dashed_edges, solid_edges, G, vertices)) continue;
+        if (remaining-- == 0) return true;
+    }
+    return false; // the index does not match this enumeration
+}
+
+void first_labelling(const SimpleGraph& G, EdgeList& best_dashed, EdgeList& best_solid) {
+    const int number_of_vertices = static_cast<int>(num_vertices(G));
+    EdgeList dashed, solid;
+    split_edges(G, dashed, solid);
+
+    best_dashed.clear();
+    best_solid.clear();
+    std::vector<int> perm(number_of_vertices);
+    std::iota(perm.begin(), perm.end(), 0);
+    do {
+        EdgeList d = relabel(dashed, perm);
+        if (!best_dashed.empty() && best_dashed < d) continue;
+        EdgeList s = relabel(solid, perm);
+        if (best_dashed.empty() || d < best_dashed || s < best_solid) {
+            best_dashed = std::move(d);
+            best_solid = std::move(s);
+        }
+    } while (std::next_permutation(perm.begin(), perm.end()));
+}
+
+long long DiagramIndex::rank(const SimpleGraph& G) const {
+    const int number_of_vertices = static_cast<int>(num_vertices(G));
+    EdgeList best_dashed, best_solid;
+    first_labelling(G, best_dashed, best_solid);
+
+    const CandidateJoin join(options_, number_of_vertices);
+    const long long row = join.dashed().find(best_dashed);
+    if (row < 0) return -1;
+    auto r = std::find_if(rows_.begin(), rows_.end(),
+                          [&](const Row& x) { return x.number_of_vertices == number_of_vertices && x.row == row; });
+    if (r == rows_.end()) return -1;
+
+    const auto autos = automorphisms_if_minimal(best_dashed, number_of_vertices);
+    long long id = r->first_id;
+    std::vector<std::size_t> partners;
+    join.partners(best_dashed, partners);
+    EdgeList solid_edges;
+    for (std::size_t s : partners) {
+        join.solid().decode(s, solid_edges);
+        if (!solid_is_orbit_minimum(solid_edges, autos)) continue;
+        SimpleGraph H;
+        std::vector<SimpleGraph::vertex_descriptor> vertices;
+        if (!build_diagram(options_, number_of_vertices, best_dashed, solid_edges, H, vertices)) continue;
+        if (solid_edges == best_solid) return id;
+        ++id;
+    }
+    return -1;
+}
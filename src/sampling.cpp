@@ -0,0 +1,228 @@
+#include "sampling.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+long double binomial(int n, int k) {
+    if (k < 0 || k > n) return 0;
+    long double result = 1;
+    for (int i = 1; i <= k; ++i) result = result * (n - k + i) / i;
+    return result;
+}
+
+// Multisets of size k drawn from m kinds.
+long double multichoose(int m, int k) {
+    if (m == 0) return k == 0 ? 1 : 0;
+    return binomial(m + k - 1, k);
+}
+
+long double factorial(int n) {
+    long double result = 1;
+    for (int i = 2; i <= n; ++i) result *= i;
+    return result;
+}
+}
+
+DiagramSampler::DiagramSampler(const EnumerationOptions& options, std::uint64_t seed)
+    : options_(options), random_(seed) {
+    const int order = options.order;
+    const int max_vertices = 2 * order;
+
+    // Closed electron loops through c given vertices, as line multisets: a
+    // tadpole, a double line, or (c - 1)! / 2 cycles.
+    loops_.assign(max_vertices + 1, 0);
+    for (int c = 1; c <= max_vertices; ++c) {
+        loops_[c] = c == 1 ? (options.ignore_fermion_loop ? 0 : 1) : c == 2 ? 1 : factorial(c - 1) / 2;
+    }
+    // Sets of loops covering m given vertices, by the loop through the first.
+    loop_sets_.assign(max_vertices + 1, 0);
+    loop_sets_[0] = 1;
+    for (int m = 1; m <= max_vertices; ++m) {
+        for (int c = 1; c <= m; ++c) loop_sets_[m] += binomial(m - 1, c - 1) * loops_[c] * loop_sets_[m - c];
+    }
+
+    // covering(u, w, k): phonon multisets of k lines on u uncovered and w
+    // covered vertices that cover the u. With u > 0 the first uncovered
+    // vertex takes j >= 1 lines, reaching t of the other uncovered vertices
+    // (once each, at least) and any mix of itself and the reached and covered
+    // vertices otherwise; it is then removed and the t become covered.
+    covering_.assign((max_vertices + 1) * (max_vertices + 1) * (order + 1), 0);
+    for (int u = 0; u <= max_vertices; ++u) {
+        for (int w = 0; u + w <= max_vertices; ++w) {
+            for (int k = 0; k <= order; ++k) {
+                long double& count = covering_[(u * (max_vertices + 1) + w) * (order + 1) + k];
+                if (u == 0) {
+                    count = multichoose(w * (w + 1) / 2, k);
+                    continue;
+                }
+                for (int j = 1; j <= k; ++j) {
+                    for (int t = 0; t <= std::min(u - 1, j); ++t) {
+                        count += binomial(u - 1, t) * multichoose(t + 1 + w, j - t) * covering(u - 1 - t, w + t, k - j);
+                    }
+                }
+            }
+        }
+    }
+
+    // Every (electron, phonon) pair of valid shape on V vertices: a path
+    // through p >= 2 of them, or one vertex without electron lines, with
+    // loops through the rest.
+    vertex_weights_.assign(max_vertices + 1, 0);
+    for (int V = 1; V <= max_vertices; ++V) {
+        if (!options.filter.accepts_vertex_count(V)) continue;
+        long double electron_sets = V * loop_sets_[V - 1];
+        for (int p = 2; p <= V; ++p) electron_sets += binomial(V, p) * factorial(p) / 2 * loop_sets_[V - p];
+        vertex_weights_[V] = electron_sets * covering(V, 0, order);
+    }
+}
+
+long double DiagramSampler::covering(int uncovered, int covered, int lines) const {
+    const int max_vertices = 2 * options_.order;
+    return covering_[(uncovered * (max_vertices + 1) + covered) * (options_.order + 1) + lines];
+}
+
+std::uint64_t DiagramSampler::below(std::uint64_t n) {
+    // Reject the top partial range of 64-bit values so every residue is
+    // equally likely.
+    const std::uint64_t threshold = (0 - n) % n;
+    while (true) {
+        const std::uint64_t r = random_();
+        if (r >= threshold) return r % n;
+    }
+}
+
+std::size_t DiagramSampler::pick(const std::vector<long double>& weights) {
+    const long double total = std::accumulate(weights.begin(), weights.end(), 0.0L);
+    long double x = static_cast<long double>(random_() >> 11) / 9007199254740992.0L * total;
+    std::size_t last = 0;
+    for (std::size_t i = 0; i < weights.size(); ++i) {
+        if (weights[i] <= 0) continue;
+        if (x < weights[i]) return i;
+        x -= weights[i];
+        last = i;
+    }
+    return last; // rounding
+}
+
+void DiagramSampler::draw_electron_lines(int number_of_vertices, EdgeList& edges) {
+    const int V = number_of_vertices;
+    // Index 0: one vertex without electron lines; index p >= 2: a path
+    // through p vertices. The rest are covered by loops.
+    std::vector<long double> shapes(V + 1, 0);
+    shapes[0] = V * loop_sets_[V - 1];
+    for (int p = 2; p <= V; ++p) shapes[p] = binomial(V, p) * factorial(p) / 2 * loop_sets_[V - p];
+    const int path = static_cast<int>(pick(shapes));
+
+    // In a uniform vertex order, the first p vertices in turn are a uniform
+    // path, and each loop takes the next vertices in turn.
+    std::vector<int> order(V);
+    std::iota(order.begin(), order.end(), 0);
+    for (int i = V - 1; i > 0; --i) std::swap(order[i], order[below(i + 1)]);
+    edges.clear();
+    for (int i = 0; i + 1 < path; ++i) edges.push_back({order[i], order[i + 1]});
+    std::vector<long double> lengths;
+    for (int start = path == 0 ? 1 : path; start < V;) {
+        const int m = V - start;
+        lengths.assign(m + 1, 0);
+        for (int c = 1; c <= m; ++c) lengths[c] = binomial(m - 1, c - 1) * loops_[c] * loop_sets_[m - c];
+        const int c = static_cast<int>(pick(lengths));
+        // c lines round the loop; for c = 2 that is the double line.
+        for (int i = 0; i < c; ++i) edges.push_back({order[start + i], order[start + (i + 1) % c]});
+        start += c;
+    }
+    for (auto& e : edges) {
+        if (e.first > e.second) std::swap(e.first, e.second);
+    }
+    std::sort(edges.begin(), edges.end());
+}
+
+void DiagramSampler::draw_phonon_lines(int number_of_vertices, EdgeList& edges) {
+    // A uniform multiset of `size` kinds out of `kinds`: a uniform size-subset
+    // of kinds + size - 1 stars and bars (Floyd's algorithm), shifted back.
+    std::vector<int> picks;
+    auto multiset = [&](int kinds, int size) {
+        picks.clear();
+        const int slots = kinds + size - 1;
+        for (int i = slots - size; i < slots; ++i) {
+            const int x = static_cast<int>(below(i + 1));
+            picks.push_back(std::find(picks.begin(), picks.end(), x) == picks.end() ? x : i);
+        }
+        std::sort(picks.begin(), picks.end());
+        for (int i = 0; i < size; ++i) picks[i] -= i;
+    };
+
+    edges.clear();
+    std::vector<int> uncovered(number_of_vertices), covered, reached;
+    std::iota(uncovered.begin(), uncovered.end(), 0);
+    int lines = options_.order;
+    std::vector<long double> weights;
+    while (!uncovered.empty()) {
+        const int r = uncovered.back();
+        uncovered.pop_back();
+        const int u = static_cast<int>(uncovered.size()) + 1, w = static_cast<int>(covered.size());
+        // Weights of (j lines at r, t uncovered vertices reached), j-major.
+        weights.assign((lines + 1) * (u + 1), 0);
+        for (int j = 1; j <= lines; ++j) {
+            for (int t = 0; t <= std::min(u - 1, j); ++t) {
+                weights[j * (u + 1) + t] =
+                    binomial(u - 1, t) * multichoose(t + 1 + w, j - t) * covering(u - 1 - t, w + t, lines - j);
+            }
+        }
+        const std::size_t choice = pick(weights);
+        const int j = static_cast<int>(choice) / (u + 1), t = static_cast<int>(choice) % (u + 1);
+
+        reached.clear();
+        for (int i = 0; i < t; ++i) {
+            const int n = static_cast<int>(uncovered.size());
+            std::swap(uncovered[below(n)], uncovered[n - 1]);
+            reached.push_back(uncovered.back());
+            uncovered.pop_back();
+        }
+        // Partners of r: each reached vertex once, then any mix of r, the
+        // reached and the covered vertices.
+        std::vector<int> partners(1, r);
+        partners.insert(partners.end(), reached.begin(), reached.end());
+        partners.insert(partners.end(), covered.begin(), covered.end());
+        for (int x : reached) edges.push_back({r, x});
+        multiset(static_cast<int>(partners.size()), j - t);
+        for (int i : picks) edges.push_back({r, partners[i]});
+        covered.insert(covered.end(), reached.begin(), reached.end());
+        lines -= j;
+    }
+    // The remaining lines join covered vertices freely.
+    const EdgeList pairs = all_vertex_pairs(static_cast<int>(covered.size()));
+    multiset(static_cast<int>(pairs.size()), lines);
+    for (int i : picks) edges.push_back({covered[pairs[i].first], covered[pairs[i].second]});
+
+    for (auto& e : edges) {
+        if (e.first > e.second) std::swap(e.first, e.second);
+    }
+    std::sort(edges.begin(), edges.end());
+}
+
+bool DiagramSampler::next(SimpleGraph& G, std::vector<SimpleGraph::vertex_descriptor>& vertices,
+                          long long max_attempts) {
+    if (std::all_of(vertex_weights_.begin(), vertex_weights_.end(), [](long double w) { return w <= 0; })) {
+        return false;
+    }
+    EdgeList dashed_edges, solid_edges;
+    std::vector<int> degree;
+    for (long long attempt = 0; attempt < max_attempts; ++attempt) {
+        ++attempts_;
+        const int number_of_vertices = static_cast<int>(pick(vertex_weights_));
+        draw_electron_lines(number_of_vertices, solid_edges);
+        draw_phonon_lines(number_of_vertices, dashed_edges);
+
+        // Degree-only filter terms, which a scan applies to its phonon rows.
+        degree.assign(number_of_vertices, 0);
+        for (const auto& e : dashed_edges) ++degree[e.first], ++degree[e.second];
+        bool accepted = std::all_of(dashed_edges.begin(), dashed_edges.end(), [&](const std::pair<int, int>& e) {
+            return options_.filter.accepts_dashed_line(e.first, e.second, degree[e.first], degree[e.second]);
+        });
+        if (accepted && build_diagram(options_, number_of_vertices, dashed_edges, solid_edges, G, vertices)) {
+            ++accepted_;
+            return true;
+        }
+    }
+    return false;
+}
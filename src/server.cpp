@@ -0,0 +1,519 @@
+#include "server.hpp"
+#include "enumeration.hpp"
+#include "composition.hpp"
+#include "svg_writer.hpp"
+#include "dot_writer.hpp"
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// --- minimal JSON (flat objects of strings, numbers and booleans) ---
+
+struct JsonValue {
+    std::string text; // string contents, or the literal for numbers/booleans
+    bool is_string = false;
+};
+using JsonObject = std::map<std::string, JsonValue>;
+
+void skip_space(const std::string& s, std::size_t& i) {
+    while (i < s.size() && std::isspace(static_cast<unsigned char>(s[i]))) ++i;
+}
+
+int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool parse_string(const std::string& s, std::size_t& i, std::string& out, std::string& error) {
+    if (i >= s.size() || s[i] != '"') { error = "expected a string"; return false; }
+    for (++i; i < s.size(); ++i) {
+        char c = s[i];
+        if (c == '"') { ++i; return true; }
+        if (c != '\\') { out += c; continue; }
+        if (++i >= s.size()) break;
+        switch (s[i]) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'u': {
+                if (i + 4 >= s.size()) { error = "truncated \\u escape"; return false; }
+                unsigned code = 0;
+                for (std::size_t k = i + 1; k <= i + 4; ++k) {
+                    const int digit = hex_digit(s[k]);
+                    if (digit < 0) { error = "invalid \\u escape '\\u" + s.substr(i + 1, 4) + "'"; return false; }
+                    code = code * 16 + static_cast<unsigned>(digit);
+                }
+                if (code < 0x80) out += static_cast<char>(code); // keys and filters are ASCII
+                i += 4;
+                break;
+            }
+            default: out += s[i]; break; // \" \\ \/
+        }
+    }
+    error = "unterminated string";
+    return false;
+}
+
+bool parse_object(const std::string& s, JsonObject& object, std::string& error) {
+    std::size_t i = 0;
+    skip_space(s, i);
+    if (i >= s.size() || s[i++] != '{') { error = "expected a JSON object"; return false; }
+    skip_space(s, i);
+    if (i < s.size() && s[i] == '}') return true;
+    while (true) {
+        std::string name;
+        skip_space(s, i);
+        if (i >= s.size() || s[i] != '"') { error = "expected a field name"; return false; }
+        if (!parse_string(s, i, name, error)) return false;
+        skip_space(s, i);
+        if (i >= s.size() || s[i++] != ':') { error = "expected ':'"; return false; }
+        skip_space(s, i);
+        JsonValue value;
+        if (i < s.size() && s[i] == '"') {
+            value.is_string = true;
+            if (!parse_string(s, i, value.text, error)) return false;
+        } else {
+            while (i < s.size() && s[i] != ',' && s[i] != '}' && !std::isspace(static_cast<unsigned char>(s[i])))
+                value.text += s[i++];
+            if (value.text.empty()) { error = "expected a value"; return false; }
+        }
+        object[name] = value;
+        skip_space(s, i);
+        if (i < s.size() && s[i] == ',') { ++i; continue; }
+        if (i < s.size() && s[i] == '}') return true;
+        error = "expected ',' or '}'";
+        return false;
+    }
+}
+
+std::string json_string(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            case '\r': out += "\\r"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+// --- catalogues ---
+
+struct Catalogue {
+    std::vector<SimpleGraph> diagrams; // in id order
+    std::vector<std::string> keys;
+    std::unordered_map<std::string, long long> ids; // canonical key -> id
+    std::map<int, long long> per_vertex_count;
+};
+
+// Catalogues by (order, improper, filter). The first request for a key builds
+// it while concurrent requests for the same key wait on the same future;
+// `cold` is set for every request that found the catalogue not yet ready.
+// Improper catalogues are composed from the cached proper ones.
+class CatalogueCache {
+public:
+    std::shared_ptr<const Catalogue> get(const EnumerationOptions& options, bool& cold) {
+        const std::string key = catalogue_key(options);
+        std::promise<std::shared_ptr<const Catalogue>> promise;
+        std::shared_future<std::shared_ptr<const Catalogue>> future;
+        bool built;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(key);
+            built = it == entries_.end();
+            if (built) {
+                future = promise.get_future().share();
+                entries_.emplace(key, future);
+            } else {
+                future = it->second;
+            }
+        }
+        cold = built || future.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+        if (built) {
+            try {
+                promise.set_value(build(options));
+            } catch (...) {
+                // Waiters see the same failure; a later request retries the build.
+                promise.set_exception(std::current_exception());
+                std::lock_guard<std::mutex> lock(mutex_);
+                entries_.erase(key);
+            }
+        }
+        return future.get();
+    }
+
+private:
+    std::shared_ptr<const Catalogue> build(const EnumerationOptions& options) {
+        auto catalogue = std::make_shared<Catalogue>();
+        auto add = [&](const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>&,
+                       const CanonicalKey& canonical_key) {
+            catalogue->ids.emplace(canonical_key.str(), static_cast<long long>(catalogue->diagrams.size()));
+            catalogue->per_vertex_count[static_cast<int>(num_vertices(G))]++;
+            catalogue->diagrams.push_back(G);
+            catalogue->keys.push_back(canonical_key.str());
+        };
+        if (options.include_improper) {
+            compose_improper_diagrams(options, [this](const EnumerationOptions& pieces) {
+                bool piece_cold;
+                auto proper = get(pieces, piece_cold);
+                return std::shared_ptr<const std::vector<SimpleGraph>>(proper, &proper->diagrams);
+            }, add);
+        } else {
+            scan_diagrams(options, add);
+        }
+        return catalogue;
+    }
+
+    std::mutex mutex_;
+    std::map<std::string, std::shared_future<std::shared_ptr<const Catalogue>>> entries_;
+};
+
+// Request latency, split by whether the request had to build a catalogue.
+class LatencyStats {
+public:
+    void record(bool cold, double microseconds) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Bucket& b = cold ? cold_ : warm_;
+        ++b.count;
+        b.total += microseconds;
+        b.max = std::max(b.max, microseconds);
+    }
+    std::string json() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ostringstream o;
+        o << "\"cold\":" << bucket_json(cold_) << ",\"warm\":" << bucket_json(warm_);
+        return o.str();
+    }
+
+private:
+    struct Bucket { long long count = 0; double total = 0, max = 0; };
+    static std::string bucket_json(const Bucket& b) {
+        std::ostringstream o;
+        o << "{\"requests\":" << b.count << ",\"mean_us\":" << (b.count ? b.total / b.count : 0.0)
+          << ",\"max_us\":" << b.max << "}";
+        return o.str();
+    }
+    std::mutex mutex_;
+    Bucket cold_, warm_;
+};
+
+class Server {
+public:
+    std::atomic<bool> stopping{false};
+
+    // One response line (without the newline) for one request line.
+    std::string handle(const std::string& line) {
+        const auto start = std::chrono::steady_clock::now();
+        bool cold = false;
+        JsonObject request;
+        std::string error, body;
+        bool ok;
+        try {
+            ok = parse_object(line, request, error) && dispatch(request, cold, body, error);
+        } catch (const std::exception& e) {
+            ok = false;
+            error = e.what();
+        }
+        body = ok ? "\"ok\":true" + body : "\"ok\":false,\"error\":" + json_string(error);
+        const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        stats_.record(cold, us);
+        std::ostringstream o;
+        o << "{" << body;
+        if (request.count("tag")) {
+            const JsonValue& tag = request["tag"];
+            o << ",\"tag\":" << (tag.is_string ? json_string(tag.text) : tag.text);
+        }
+        o << ",\"cache\":\"" << (cold ? "cold" : "warm") << "\",\"latency_us\":" << us << "}";
+        return o.str();
+    }
+
+private:
+    bool dispatch(JsonObject& request, bool& cold, std::string& body, std::string& error) {
+        const std::string op = request["op"].text;
+        if (op == "stats") {
+            body = ",\"catalogue_requests\":" + std::to_string(requests_.load()) + "," + stats_.json();
+            return true;
+        }
+        if (op == "shutdown") {
+            stopping = true;
+            return true;
+        }
+        if (op != "count" && op != "diagram" && op != "lookup") {
+            error = "unknown op '" + op + "'";
+            return false;
+        }
+
+        EnumerationOptions options;
+        options.order = std::atoi(request["order"].text.c_str());
+        if (options.order < 1 || options.order > 4) {
+            error = "order must be 1, 2, 3 or 4";
+            return false;
+        }
+        options.include_improper = request["improper"].text == "true";
+        options.skeleton_only = request["skeleton"].text == "true";
+        if (options.include_improper && options.skeleton_only) {
+            error = "skeleton diagrams are proper; drop \"improper\"";
+            return false;
+        }
+        if (!parse_filter(request["filter"].text, options.filter, error)) return false;
+
+        ++requests_;
+        auto catalogue = cache_.get(options, cold);
+        const long long size = static_cast<long long>(catalogue->diagrams.size());
+        std::ostringstream o;
+        if (op == "count") {
+            o << ",\"count\":" << size << ",\"per_vertex_count\":{";
+            bool first = true;
+            for (const auto& kv : catalogue->per_vertex_count) {
+                o << (first ? "" : ",") << "\"" << kv.first << "\":" << kv.second;
+                first = false;
+            }
+            o << "}";
+        } else if (op == "lookup") {
+            auto it = catalogue->ids.find(request["key"].text);
+            o << ",\"id\":" << (it == catalogue->ids.end() ? -1 : it->second);
+        } else {
+            const long long id = std::atoll(request["id"].text.c_str());
+            if (request["id"].text.empty() || id < 0 || id >= size) {
+                error = "id out of range (catalogue has " + std::to_string(size) + " diagrams)";
+                return false;
+            }
+            const std::string format = request.count("format") ? request["format"].text : "svg";
+            std::string payload;
+            if (format == "svg") {
+                payload = render_svg(catalogue->diagrams[id], request["compact"].text == "true");
+            } else if (format == "dot") {
+                append_dot(catalogue->diagrams[id], payload);
+            } else {
+                error = "unknown format '" + format + "'";
+                return false;
+            }
+            o << ",\"id\":" << id << ",\"key\":" << json_string(catalogue->keys[id]) << ",\"format\":\"" << format
+              << "\",\"payload\":" << json_string(payload);
+        }
+        body = o.str();
+        return true;
+    }
+
+    CatalogueCache cache_;
+    LatencyStats stats_;
+    std::atomic<long long> requests_{0};
+};
+
+// Fixed set of workers draining a task queue.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads) {
+        for (int i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        ready_.wait(lock, [this] { return done_ || !tasks_.empty(); });
+                        if (tasks_.empty()) return;
+                        task = std::move(tasks_.front());
+                        tasks_.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        ready_.notify_all();
+        for (auto& w : workers_) w.join();
+    }
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push(std::move(task));
+        }
+        ready_.notify_one();
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    bool done_ = false;
+};
+
+bool send_all(int fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// One socket client. The accept loop reads its request lines into `lines`;
+// at most one pool task at a time drains them, so responses keep request order
+// while idle connections hold no worker. The fd closes with the last owner.
+struct Connection {
+    explicit Connection(int fd) : fd(fd) {}
+    ~Connection() { ::close(fd); }
+    const int fd;
+    std::string pending; // bytes after the last newline; accept loop only
+    std::mutex mutex;
+    std::queue<std::string> lines;
+    bool draining = false;
+};
+
+// Answers the queued lines of `connection` until its queue is empty.
+void drain_connection(Server& server, const std::shared_ptr<Connection>& connection, int wake_fd) {
+    while (true) {
+        std::string line;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (connection->lines.empty() || server.stopping) {
+                connection->draining = false;
+                return;
+            }
+            line = std::move(connection->lines.front());
+            connection->lines.pop();
+        }
+        send_all(connection->fd, server.handle(line) + "\n"); // a dead client shows up as a hangup in poll
+        if (server.stopping) {
+            const char byte = 0;
+            (void)!::write(wake_fd, &byte, 1); // wakes the accept loop
+        }
+    }
+}
+
+int serve_socket(Server& server, const std::string& path, int threads) {
+    int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (listen_fd < 0 || path.size() >= sizeof(addr.sun_path)) {
+        std::cout << "Cannot create socket " << path << std::endl;
+        return 1;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    ::unlink(path.c_str());
+    int wake[2];
+    if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listen_fd, 64) != 0 ||
+        ::pipe(wake) != 0) {
+        std::cout << "Cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+        ::close(listen_fd);
+        return 1;
+    }
+    std::cout << "Serving on " << path << " with " << threads << " threads" << std::endl;
+    std::map<int, std::shared_ptr<Connection>> connections;
+    {
+        ThreadPool pool(threads);
+        std::vector<pollfd> fds;
+        char buf[4096];
+        while (!server.stopping) {
+            fds.assign({{listen_fd, POLLIN, 0}, {wake[0], POLLIN, 0}});
+            for (const auto& kv : connections) fds.push_back({kv.first, POLLIN, 0});
+            if (::poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (std::size_t k = 2; k < fds.size(); ++k) {
+                if (!fds[k].revents) continue;
+                auto connection = connections[fds[k].fd];
+                ssize_t n = ::recv(connection->fd, buf, sizeof(buf), 0);
+                if (n <= 0) {
+                    connections.erase(connection->fd);
+                    continue;
+                }
+                connection->pending.append(buf, static_cast<std::size_t>(n));
+                std::size_t newline;
+                bool submit = false;
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                while ((newline = connection->pending.find('\n')) != std::string::npos) {
+                    std::string line = connection->pending.substr(0, newline);
+                    connection->pending.erase(0, newline + 1);
+                    if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+                    connection->lines.push(std::move(line));
+                    submit = !connection->draining;
+                }
+                if (submit) {
+                    connection->draining = true;
+                    pool.submit([&server, connection, wake] { drain_connection(server, connection, wake[1]); });
+                }
+            }
+            if (fds[0].revents & POLLIN) {
+                int fd = ::accept(listen_fd, nullptr, nullptr);
+                if (fd >= 0) connections.emplace(fd, std::make_shared<Connection>(fd));
+            }
+        }
+        // Unblock clients waiting on a response; running tasks finish their current line.
+        for (const auto& kv : connections) ::shutdown(kv.first, SHUT_RDWR);
+    }
+    connections.clear();
+    ::close(wake[0]);
+    ::close(wake[1]);
+    ::close(listen_fd);
+    ::unlink(path.c_str());
+    return 0;
+}
+
+int serve_stream(Server& server, std::istream& in, std::ostream& out) {
+    std::string line;
+    while (!server.stopping && std::getline(in, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        out << server.handle(line) << std::endl;
+    }
+    return 0;
+}
+
+} // namespace
+
+int run_server(const ServerOptions& options) {
+    Server server;
+    if (!options.socket_path.empty()) {
+        int threads = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+        return serve_socket(server, options.socket_path, std::max(1, threads));
+    }
+    return serve_stream(server, std::cin, std::cout);
+}
+
+int serve_stream(std::istream& in, std::ostream& out) {
+    Server server;
+    return serve_stream(server, in, out);
+}
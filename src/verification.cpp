@@ -0,0 +1,381 @@
+#include "verification.hpp"
+#include "dot_writer.hpp"
+#include <boost/graph/connected_components.hpp>
+#include <boost/graph/isomorphism.hpp>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+using PlainGraph = boost::adjacency_list<boost::vecS, boost::vecS, boost::undirectedS>;
+
+// G with every line replaced by a vertex of its style joined to the line's
+// ends (to one end for a loop), so parallel lines and loops become a simple
+// graph. Vertices are told apart by kind (diagram vertex, electron line,
+// phonon line) and degree, which boost::isomorphism takes as its invariant.
+struct Subdivided {
+    PlainGraph graph;
+    std::vector<std::size_t> invariant;
+    std::vector<std::size_t> signature; // sorted invariants, for bucketing
+};
+
+Subdivided subdivide(const SimpleGraph& G) {
+    Subdivided s;
+    s.graph = PlainGraph(num_vertices(G));
+    s.invariant.assign(num_vertices(G), 0);
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        const auto a = source(*er.first, G), b = target(*er.first, G);
+        const auto line = add_vertex(s.graph);
+        s.invariant.push_back(G[*er.first].style == LineStyle::Solid ? 1 : 2);
+        add_edge(a, line, s.graph);
+        if (b != a) add_edge(b, line, s.graph);
+    }
+    for (std::size_t v = 0; v < s.invariant.size(); ++v) s.invariant[v] += 3 * degree(v, s.graph);
+    s.signature = s.invariant;
+    std::sort(s.signature.begin(), s.signature.end());
+    return s;
+}
+
+struct Invariant {
+    typedef std::size_t result_type;
+    typedef PlainGraph::vertex_descriptor argument_type;
+    const std::vector<std::size_t>* values;
+    result_type operator()(argument_type v) const { return (*values)[v]; }
+};
+
+bool isomorphic(const Subdivided& a, const Subdivided& b) {
+    if (a.signature != b.signature || num_edges(a.graph) != num_edges(b.graph)) return false;
+    std::vector<PlainGraph::vertex_descriptor> f(num_vertices(a.graph));
+    const std::size_t max_invariant = a.signature.empty() ? 1 : a.signature.back() + 1;
+    return boost::isomorphism(a.graph, b.graph,
+                              boost::make_iterator_property_map(f.begin(), get(boost::vertex_index, a.graph)),
+                              Invariant{&a.invariant}, Invariant{&b.invariant}, max_invariant,
+                              get(boost::vertex_index, a.graph), get(boost::vertex_index, b.graph));
+}
+
+// Connected components of G without the lines numbered `skip_a` and `skip_b`
+// (in edges(G) order); fills `component` and returns their number.
+int components_without(const SimpleGraph& G, std::size_t skip_a, std::size_t skip_b, std::vector<int>& component) {
+    PlainGraph H(num_vertices(G));
+    std::size_t index = 0;
+    for (auto er = edges(G); er.first != er.second; ++er.first, ++index) {
+        if (index != skip_a && index != skip_b) add_edge(source(*er.first, G), target(*er.first, G), H);
+    }
+    component.resize(num_vertices(G));
+    return boost::connected_components(H, component.data());
+}
+
+constexpr std::size_t no_line = static_cast<std::size_t>(-1);
+
+// Indices of the electron lines that join two different vertices.
+std::vector<std::size_t> internal_lines(const SimpleGraph& G) {
+    std::vector<std::size_t> lines;
+    std::size_t index = 0;
+    for (auto er = edges(G); er.first != er.second; ++er.first, ++index) {
+        if (G[*er.first].style == LineStyle::Solid && source(*er.first, G) != target(*er.first, G)) {
+            lines.push_back(index);
+        }
+    }
+    return lines;
+}
+
+bool reference_is_proper(const SimpleGraph& G) {
+    std::vector<int> component;
+    for (std::size_t line : internal_lines(G)) {
+        if (components_without(G, line, no_line, component) != 1) return false;
+    }
+    return true;
+}
+
+bool reference_is_skeleton(const SimpleGraph& G) {
+    int initial = 0, final = 0;
+    for (int v = 0; v < static_cast<int>(num_vertices(G)); ++v) {
+        if (G[v].initial) initial = v;
+        if (G[v].final) final = v;
+    }
+    const auto lines = internal_lines(G);
+    std::vector<int> component;
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        for (std::size_t j = i + 1; j < lines.size(); ++j) {
+            if (components_without(G, lines[i], lines[j], component) > 1 && component[initial] == component[final]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool reference_accepts(const DiagramFilter& filter, const SimpleGraph& G) {
+    const int V = static_cast<int>(num_vertices(G));
+    if (V < filter.min_vertices || V > filter.max_vertices) return false;
+    std::vector<int> phonons(V, 0);
+    for (auto er = edges(G); er.first != er.second; ++er.first) {
+        if (G[*er.first].style != LineStyle::Dashed) continue;
+        const int a = static_cast<int>(source(*er.first, G)), b = static_cast<int>(target(*er.first, G));
+        if (filter.no_tadpoles && a == b) return false;
+        ++phonons[a];
+        ++phonons[b];
+    }
+    for (int p : phonons) {
+        if (p > filter.max_phonons_per_vertex) return false;
+    }
+    return filter.accepts_topology(G);
+}
+
+// Every multiset of `size` vertex pairs on n vertices, as a sorted edge list,
+// in lexicographic order.
+void edge_multisets(int n, int size, const std::function<void(const EdgeList&)>& visit) {
+    EdgeList pairs, current;
+    for (int i = 0; i < n; ++i) {
+        for (int j = i; j < n; ++j) pairs.push_back({i, j});
+    }
+    std::function<void(std::size_t)> extend = [&](std::size_t start) {
+        if (static_cast<int>(current.size()) == size) {
+            visit(current);
+            return;
+        }
+        for (std::size_t p = start; p < pairs.size(); ++p) {
+            current.push_back(pairs[p]);
+            extend(p);
+            current.pop_back();
+        }
+    };
+    extend(0);
+}
+
+class Recorder {
+public:
+    explicit Recorder(VerificationReport& report) : report_(report) {}
+
+    VerificationCheck& check(const std::string& name) {
+        for (auto& c : report_.checks) {
+            if (c.name == name) return c;
+        }
+        report_.checks.push_back(VerificationCheck{name, 0, 0, "", SimpleGraph()});
+        return report_.checks.back();
+    }
+    void compared(const std::string& name) { ++check(name).compared; }
+    // Keep the message and diagram of the smallest mismatch of each check.
+    void mismatch(const std::string& name, const SimpleGraph& G, const std::string& message) {
+        VerificationCheck& c = check(name);
+        const bool smaller = c.mismatches == 0 || num_vertices(G) < num_vertices(c.smallest) ||
+                             (num_vertices(G) == num_vertices(c.smallest) && num_edges(G) < num_edges(c.smallest));
+        ++c.mismatches;
+        if (smaller) {
+            c.smallest = G;
+            c.message = message;
+            for (auto vr = vertices(c.smallest); vr.first != vr.second; ++vr.first) {
+                c.smallest[*vr.first].label = std::to_string(c.smallest[*vr.first].dashed_degree);
+            }
+        }
+    }
+
+private:
+    VerificationReport& report_;
+};
+
+std::string describe(const EdgeList& dashed, const EdgeList& solid) {
+    std::ostringstream out;
+    out << "phonon";
+    for (const auto& e : dashed) out << " " << e.first << "-" << e.second;
+    out << ", electron";
+    for (const auto& e : solid) out << " " << e.first << "-" << e.second;
+    return out.str();
+}
+
+// An isomorphism class found by the brute-force scan.
+struct Class {
+    SimpleGraph representative;
+    Subdivided shape;
+    std::string key;
+};
+}
+
+bool VerificationReport::passed() const {
+    return std::all_of(checks.begin(), checks.end(), [](const VerificationCheck& c) { return c.mismatches == 0; });
+}
+
+std::string VerificationReport::summary() const {
+    std::ostringstream out;
+    for (const auto& c : checks) {
+        out << c.name << ": " << c.compared << " compared, " << c.mismatches << " mismatches\n";
+    }
+    for (const auto& c : checks) {
+        if (c.mismatches) out << c.name << " mismatch (smallest): " << c.message << "\n";
+    }
+    return out.str();
+}
+
+void VerificationReport::write_mismatches(const std::string& directory) const {
+    for (const auto& c : checks) {
+        if (c.mismatches) write_dot(c.smallest, directory + "/verify_" + c.name + ".dot");
+    }
+}
+
+VerificationReport verify_run(const EnumerationOptions& options, int sample_every) {
+    VerificationReport report;
+    Recorder record(report);
+    for (const char* name : {"bridge", "skeleton", "canonical", "pruning"}) record.check(name);
+    const bool complete = sample_every <= 1;
+    if (complete) {
+        record.check("count");
+        record.check("order");
+    }
+
+    std::vector<Class> classes;
+    std::unordered_map<std::string, std::size_t> class_of_key;
+    std::map<std::vector<std::size_t>, std::vector<std::size_t>> buckets; // signature -> classes
+
+    for (int number_of_vertices = 1; number_of_vertices <= 2 * options.order; ++number_of_vertices) {
+        std::vector<EdgeList> dashed_rows, solid_rows;
+        long long row = 0;
+        edge_multisets(number_of_vertices, options.order, [&](const EdgeList& dashed) {
+            std::vector<bool> covered(number_of_vertices, false);
+            for (const auto& e : dashed) covered[e.first] = covered[e.second] = true;
+            if (std::find(covered.begin(), covered.end(), false) != covered.end()) return;
+            if (row++ % std::max(sample_every, 1) == 0) dashed_rows.push_back(dashed);
+        });
+        edge_multisets(number_of_vertices, number_of_vertices - 1, [&](const EdgeList& solid) {
+            std::vector<int> electrons(number_of_vertices, 0);
+            for (const auto& e : solid) {
+                if (++electrons[e.first] > 2 || ++electrons[e.second] > 2) return;
+            }
+            solid_rows.push_back(solid);
+        });
+
+        const CandidateJoin join(options, number_of_vertices);
+
+        for (const auto& dashed : dashed_rows) {
+            const long long dashed_kept = join.dashed().find(dashed);
+            std::vector<std::size_t> partners;
+            if (dashed_kept >= 0) join.partners(dashed, partners);
+            for (const auto& solid : solid_rows) {
+                SimpleGraph G;
+                std::vector<SimpleGraph::vertex_descriptor> vertices;
+                std::tie(G, vertices) = get_initial_graph_and_vertices(number_of_vertices);
+                add_styled_edges(G, vertices, dashed, /*dashed=*/true);
+                add_styled_edges(G, vertices, solid, /*dashed=*/false);
+                std::vector<int> component;
+                if (components_without(G, no_line, no_line, component) != 1) continue;
+                if (!classify_and_validate_shape(G, vertices, options.ignore_fermion_loop)) continue;
+
+                const bool proper = reference_is_proper(G);
+                record.compared("bridge");
+                if (is_proper_diagram(G) != proper) {
+                    record.mismatch("bridge", G, std::string("is_proper_diagram says ") + (proper ? "improper" : "proper") +
+                                                     " for " + describe(dashed, solid));
+                }
+                const bool skeleton = proper && reference_is_skeleton(G);
+                if (proper) {
+                    record.compared("skeleton");
+                    if (is_skeleton_diagram(G) != skeleton) {
+                        record.mismatch("skeleton", G, std::string("is_skeleton_diagram says ") +
+                                                           (skeleton ? "not a skeleton" : "skeleton") + " for " +
+                                                           describe(dashed, solid));
+                    }
+                }
+                if (!options.include_improper && !proper) continue;
+                if (options.skeleton_only && !skeleton) continue;
+                if (!reference_accepts(options.filter, G)) continue;
+
+                record.compared("pruning");
+                const long long solid_kept = join.solid().find(solid);
+                const char* dropped_by = dashed_kept < 0  ? "dashed_candidates"
+                                         : solid_kept < 0 ? "solid_candidates"
+                                         : !std::binary_search(partners.begin(), partners.end(),
+                                                               static_cast<std::size_t>(solid_kept))
+                                             ? "the candidate join"
+                                             : nullptr;
+                if (dropped_by) {
+                    record.mismatch("pruning", G, std::string("accepted candidate dropped by ") + dropped_by + ": " +
+                                                      describe(dashed, solid));
+                }
+
+                // Sort the candidate into its isomorphism class, checking its
+                // canonical key against the class found by boost::isomorphism.
+                record.compared("canonical");
+                std::string key = canonical_form(G);
+                Subdivided shape = subdivide(G);
+                auto known = class_of_key.find(key);
+                if (known != class_of_key.end()) {
+                    if (!isomorphic(shape, classes[known->second].shape)) {
+                        record.mismatch("canonical", G, "equal canonical keys for non-isomorphic diagrams: " +
+                                                            describe(dashed, solid));
+                    }
+                    continue;
+                }
+                auto& bucket = buckets[shape.signature];
+                auto match = std::find_if(bucket.begin(), bucket.end(),
+                                          [&](std::size_t c) { return isomorphic(shape, classes[c].shape); });
+                if (match != bucket.end()) {
+                    record.mismatch("canonical", G, "different canonical keys for isomorphic diagrams: " +
+                                                        describe(dashed, solid));
+                    class_of_key.emplace(std::move(key), *match);
+                    continue;
+                }
+                class_of_key.emplace(key, classes.size());
+                bucket.push_back(classes.size());
+                classes.push_back(Class{G, std::move(shape), std::move(key)});
+            }
+        }
+    }
+
+    // The optimized run: distinct keys, pairwise non-isomorphic diagrams, and
+    // (on a complete scan) exactly the brute-force classes in id order.
+    std::vector<Class> emitted;
+    enumerate_diagrams(options, [&](const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>&,
+                                    const CanonicalKey& key) { emitted.push_back(Class{G, subdivide(G), key.str()}); });
+    std::map<std::vector<std::size_t>, std::vector<std::size_t>> emitted_buckets;
+    for (std::size_t i = 0; i < emitted.size(); ++i) emitted_buckets[emitted[i].shape.signature].push_back(i);
+    for (const auto& bucket : emitted_buckets) {
+        for (std::size_t a = 0; a < bucket.second.size(); ++a) {
+            for (std::size_t b = a + 1; b < bucket.second.size(); ++b) {
+                const Class& x = emitted[bucket.second[a]];
+                const Class& y = emitted[bucket.second[b]];
+                record.compared("canonical");
+                if (isomorphic(x.shape, y.shape)) {
+                    record.mismatch("canonical", x.representative,
+                                    "diagrams " + std::to_string(bucket.second[a]) + " and " +
+                                        std::to_string(bucket.second[b]) + " of the run are isomorphic");
+                }
+            }
+        }
+    }
+    if (!complete) return report;
+
+    std::vector<bool> found(classes.size(), false);
+    for (std::size_t i = 0; i < emitted.size(); ++i) {
+        record.compared("count");
+        const auto bucket = buckets.find(emitted[i].shape.signature);
+        bool matched = false;
+        if (bucket != buckets.end()) {
+            for (std::size_t c : bucket->second) {
+                if (!found[c] && isomorphic(emitted[i].shape, classes[c].shape)) {
+                    found[c] = matched = true;
+                    break;
+                }
+            }
+        }
+        if (!matched) {
+            record.mismatch("count", emitted[i].representative,
+                            "diagram " + std::to_string(i) + " of the run is not a brute-force class");
+        }
+    }
+    for (std::size_t c = 0; c < classes.size(); ++c) {
+        if (!found[c]) {
+            record.mismatch("count", classes[c].representative,
+                            "brute-force class " + std::to_string(c) + " is missing from the run");
+        }
+    }
+    for (std::size_t i = 0; i < std::min(emitted.size(), classes.size()); ++i) {
+        record.compared("order");
+        if (emitted[i].key != classes[i].key || !isomorphic(emitted[i].shape, classes[i].shape)) {
+            record.mismatch("order", emitted[i].representative,
+                            "diagram " + std::to_string(i) + " of the run is not brute-force diagram " +
+                                std::to_string(i));
+        }
+    }
+    return report;
+}
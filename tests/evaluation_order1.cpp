@@ -0,0 +1,78 @@
+// Evaluation check: the two order-1 diagrams, compiled and summed on the
+// Matsubara grid, against their closed forms for a two-level band:
+//   contact (one vertex):  g^2 coth(beta omega0 / 2)
+//   Fock (two vertices):   g^2 sum_k w_k [ (n_B + 1 - n_F(xi_k)) / (i omega - xi_k - omega0)
+//                                        + (n_B + n_F(xi_k)) / (i omega - xi_k + omega0) ]
+// and checks that the result does not depend on the number of threads.
+//
+// usage: evaluation_order1
+
+#include "enumeration.hpp"
+#include "evaluation.hpp"
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main() {
+    HolsteinModel model;
+    std::string error;
+    if (!parse_model("beta=2,g=0.7,omega0=1.3,mu=0.1,level=-0.4:0.3,level=0.9:0.7,cutoff=20000,frequencies=8", model,
+                     error)) {
+        std::cerr << "FAIL model: " << error << "\n";
+        return 1;
+    }
+
+    EnumerationOptions options;
+    options.order = 1;
+    std::vector<CompiledDiagram> compiled;
+    std::vector<int> vertex_counts;
+    enumerate_diagrams(options, [&](const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>&,
+                                    const CanonicalKey&) {
+        CompiledDiagram d;
+        if (compile_diagram(G, d)) compiled.push_back(d);
+        vertex_counts.push_back(static_cast<int>(num_vertices(G)));
+    });
+    if (compiled.size() != 2) {
+        std::cerr << "FAIL expected 2 compiled order-1 diagrams, got " << compiled.size() << "\n";
+        return 1;
+    }
+
+    const auto values = evaluate_diagrams(compiled, model, 1);
+    const auto threaded = evaluate_diagrams(compiled, model, 3);
+
+    const double g2 = model.coupling * model.coupling, w0 = model.phonon_frequency, beta = model.beta;
+    const double n_b = 1.0 / (std::exp(beta * w0) - 1.0);
+    int failures = 0;
+    for (std::size_t d = 0; d < compiled.size(); ++d) {
+        for (int n = 0; n < model.frequencies; ++n) {
+            const std::complex<double> i_omega(0.0, (2 * n + 1) * M_PI / beta);
+            std::complex<double> expected;
+            double tolerance;
+            if (vertex_counts[d] == 1) {
+                expected = g2 / std::tanh(beta * w0 / 2);
+                tolerance = 1e-4; // the truncated sum converges as 1/cutoff
+            } else {
+                for (const auto& level : model.levels) {
+                    const double xi = level.first - model.chemical_potential;
+                    const double n_f = 1.0 / (std::exp(beta * xi) + 1.0);
+                    expected += g2 * level.second *
+                                ((n_b + 1 - n_f) / (i_omega - xi - w0) + (n_b + n_f) / (i_omega - xi + w0));
+                }
+                tolerance = 1e-7;
+            }
+            const double error_abs = std::abs(values[d][n] - expected);
+            if (error_abs > tolerance * std::abs(expected)) {
+                std::cerr << "FAIL diagram " << d << " (" << vertex_counts[d] << " vertices) n=" << n << ": got "
+                          << values[d][n] << ", expected " << expected << "\n";
+                ++failures;
+            }
+            if (std::abs(threaded[d][n] - values[d][n]) > 1e-12 * std::abs(expected)) {
+                std::cerr << "FAIL diagram " << d << " n=" << n << " differs with 3 threads\n";
+                ++failures;
+            }
+        }
+    }
+    std::cout << "order-1 evaluation: " << (failures ? "FAILED" : "ok") << "\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+// Golden-count regression test: runs the generator's enumeration for one
+// order (proper, improper or skeleton) and compares the diagram count, the
+// number of diagrams per vertex count and the canonical keys in id order with
+// a golden file. The run must also stay within a wall-time and peak-memory
+// budget.
+//
+// usage: golden_counts <order> <proper|improper|skeleton> <golden-file> <max-seconds> <max-rss-mb>
+//        golden_counts <order> <proper|improper|skeleton> <golden-file> --write
+
+#include "enumeration.hpp"
+#include <sys/resource.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+struct Catalogue {
+    long long count = 0;
+    std::map<int, long long> per_vertex_count;
+    std::vector<std::string> keys; // in id order
+};
+
+std::string describe(const Catalogue& c, int order, const std::string& kind) {
+    std::ostringstream o;
+    o << "# order " << order << " " << kind << "\n";
+    o << "count " << c.count << "\n";
+    for (const auto& kv : c.per_vertex_count) o << "vertices " << kv.first << " " << kv.second << "\n";
+    for (const auto& k : c.keys) o << "key " << k << "\n";
+    return o.str();
+}
+
+bool read_golden(const std::string& path, Catalogue& c) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string tag;
+        ls >> tag;
+        if (tag == "count") ls >> c.count;
+        else if (tag == "vertices") { int v; long long n; ls >> v >> n; c.per_vertex_count[v] = n; }
+        else if (tag == "key") c.keys.push_back(line.substr(4));
+    }
+    return true;
+}
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        std::cerr << "usage: golden_counts <order> <proper|improper|skeleton> <golden-file> (<max-seconds> <max-rss-mb> | --write)\n";
+        return 2;
+    }
+    EnumerationOptions options;
+    options.order = std::atoi(argv[1]);
+    const std::string kind = argv[2];
+    options.include_improper = kind == "improper";
+    options.skeleton_only = kind == "skeleton";
+    const std::string golden_path = argv[3];
+
+    const auto start = std::chrono::steady_clock::now();
+    Catalogue actual;
+    actual.count = enumerate_diagrams(options, [&](const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>&,
+                                                   const CanonicalKey& key) {
+        actual.per_vertex_count[static_cast<int>(num_vertices(G))]++;
+        actual.keys.push_back(key.str());
+    });
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    const double peak_mb = usage.ru_maxrss / 1024.0; // ru_maxrss is in KiB on Linux
+
+    if (std::string(argv[4]) == "--write") {
+        std::ofstream(golden_path) << describe(actual, options.order, kind);
+        std::cout << "wrote " << golden_path << " (" << actual.count << " diagrams)\n";
+        return 0;
+    }
+
+    Catalogue golden;
+    if (!read_golden(golden_path, golden)) {
+        std::cerr << "cannot read golden file " << golden_path << "\n";
+        return 1;
+    }
+
+    int failures = 0;
+    if (actual.count != golden.count) {
+        std::cerr << "FAIL count: got " << actual.count << ", expected " << golden.count << "\n";
+        ++failures;
+    }
+    if (actual.per_vertex_count != golden.per_vertex_count) {
+        std::cerr << "FAIL per-vertex-count breakdown:\n";
+        std::set<int> vs;
+        for (const auto& kv : actual.per_vertex_count) vs.insert(kv.first);
+        for (const auto& kv : golden.per_vertex_count) vs.insert(kv.first);
+        for (int v : vs) {
+            std::cerr << "  " << v << " vertices: got " << actual.per_vertex_count[v] << ", expected "
+                      << golden.per_vertex_count[v] << "\n";
+        }
+        ++failures;
+    }
+    const std::set<std::string> actual_set(actual.keys.begin(), actual.keys.end());
+    const std::set<std::string> golden_set(golden.keys.begin(), golden.keys.end());
+    if (actual_set != golden_set) {
+        for (const auto& k : actual_set) if (!golden_set.count(k)) std::cerr << "FAIL unexpected key " << k << "\n";
+        for (const auto& k : golden_set) if (!actual_set.count(k)) std::cerr << "FAIL missing key " << k << "\n";
+        ++failures;
+    } else if (actual.keys != golden.keys) {
+        for (std::size_t i = 0; i < actual.keys.size(); ++i) {
+            if (actual.keys[i] != golden.keys[i]) {
+                std::cerr << "FAIL id order changed: first difference at id " << i << "\n";
+                break;
+            }
+        }
+        ++failures;
+    }
+
+    const double max_seconds = std::atof(argv[4]), max_mb = argc > 5 ? std::atof(argv[5]) : 0;
+    std::cout << "order " << options.order << " " << kind << ": "
+              << actual.count << " diagrams, " << seconds << " s (budget " << max_seconds << " s), peak "
+              << peak_mb << " MiB (budget " << max_mb << " MiB)\n";
+    if (max_seconds > 0 && seconds > max_seconds) {
+        std::cerr << "FAIL wall time " << seconds << " s exceeds budget " << max_seconds << " s\n";
+        ++failures;
+    }
+    if (max_mb > 0 && peak_mb > max_mb) {
+        std::cerr << "FAIL peak memory " << peak_mb << " MiB exceeds budget " << max_mb << " MiB\n";
+        ++failures;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+// Rank/unrank check: for every id of one run, unranks the diagram, relabels
+// its vertices in reverse order and ranks it again; the id must come back.
+// The index is built fresh in <index-file>.
+//
+// usage: rank_roundtrip <order> <proper|improper|skeleton> <index-file>
+
+#include "rank.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "usage: rank_roundtrip <order> <proper|improper|skeleton> <index-file>\n";
+        return 2;
+    }
+    EnumerationOptions options;
+    options.order = std::atoi(argv[1]);
+    const std::string kind = argv[2];
+    options.include_improper = kind == "improper";
+    options.skeleton_only = kind == "skeleton";
+    std::remove(argv[3]);
+    const DiagramIndex index = DiagramIndex::load_or_build(options, "", argv[3]);
+
+    int failures = 0;
+    for (long long id = 0; id < index.size(); ++id) {
+        SimpleGraph G;
+        std::vector<SimpleGraph::vertex_descriptor> vertices;
+        if (!index.unrank(id, G, vertices)) {
+            std::cerr << "FAIL unrank(" << id << ") failed\n";
+            ++failures;
+            continue;
+        }
+        const int n = static_cast<int>(num_vertices(G));
+        std::vector<std::pair<int, int>> dashed, solid;
+        for (auto er = edges(G); er.first != er.second; ++er.first) {
+            const int a = n - 1 - static_cast<int>(source(*er.first, G));
+            const int b = n - 1 - static_cast<int>(target(*er.first, G));
+            (G[*er.first].style == LineStyle::Dashed ? dashed : solid).push_back({a, b});
+        }
+        SimpleGraph H;
+        std::vector<SimpleGraph::vertex_descriptor> relabelled;
+        std::tie(H, relabelled) = get_initial_graph_and_vertices(n);
+        add_styled_edges(H, relabelled, dashed, true);
+        add_styled_edges(H, relabelled, solid, false);
+        const long long ranked = index.rank(H);
+        if (ranked != id) {
+            std::cerr << "FAIL rank(unrank(" << id << ")) = " << ranked << "\n";
+            ++failures;
+        }
+    }
+    std::cout << "order " << options.order << " " << kind << ": " << index.size() << " ids, "
+              << (failures ? "FAILED" : "ok") << "\n";
+    return failures ? 1 : 0;
+}
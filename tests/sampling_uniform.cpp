@@ -0,0 +1,91 @@
+// Sampling check: draws diagrams of one run with DiagramSampler and compares
+// them with the full enumeration. Every sample must be a diagram of the run,
+// with the automorphism count of its class, and the class frequencies must
+// pass a chi-square test against the labelled-uniform law, class C with V
+// vertices having weight V! / |Aut C|.
+//
+// usage: sampling_uniform <order> <proper|improper|skeleton> <samples> [filter]
+
+#include "sampling.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "usage: sampling_uniform <order> <proper|improper|skeleton> <samples> [filter]\n";
+        return 2;
+    }
+    EnumerationOptions options;
+    options.order = std::atoi(argv[1]);
+    const std::string kind = argv[2];
+    options.include_improper = kind == "improper";
+    options.skeleton_only = kind == "skeleton";
+    const long long samples = std::atoll(argv[3]);
+    if (argc > 4) {
+        std::string error;
+        if (!parse_filter(argv[4], options.filter, error)) {
+            std::cerr << "FAIL filter: " << error << "\n";
+            return 2;
+        }
+    }
+
+    struct Class {
+        long long automorphisms;
+        double weight;
+        long long observed = 0;
+    };
+    std::map<std::string, Class> classes;
+    double total_weight = 0;
+    enumerate_diagrams(options, [&](const SimpleGraph& G, const std::vector<SimpleGraph::vertex_descriptor>&,
+                                    const CanonicalKey&) {
+        long long automorphisms = 0;
+        const std::string key = canonical_form(G, refine_colours(G), &automorphisms);
+        const double weight = std::tgamma(static_cast<double>(num_vertices(G)) + 1) / automorphisms;
+        classes[key] = {automorphisms, weight};
+        total_weight += weight;
+    });
+
+    DiagramSampler sampler(options, 12345);
+    SimpleGraph G;
+    std::vector<SimpleGraph::vertex_descriptor> vertices;
+    for (long long i = 0; i < samples; ++i) {
+        if (!sampler.next(G, vertices)) {
+            std::cerr << "FAIL no diagram accepted at sample " << i << "\n";
+            return 1;
+        }
+        long long automorphisms = 0;
+        const std::string key = canonical_form(G, refine_colours(G), &automorphisms);
+        auto c = classes.find(key);
+        if (c == classes.end()) {
+            std::cerr << "FAIL sample " << i << " is not a diagram of the run: " << key << "\n";
+            return 1;
+        }
+        if (c->second.automorphisms != automorphisms) {
+            std::cerr << "FAIL sample " << i << " has " << automorphisms << " automorphisms, its class "
+                      << c->second.automorphisms << "\n";
+            return 1;
+        }
+        ++c->second.observed;
+    }
+
+    double chi_square = 0, smallest_expected = samples;
+    for (const auto& c : classes) {
+        const double expected = samples * c.second.weight / total_weight;
+        chi_square += (c.second.observed - expected) * (c.second.observed - expected) / expected;
+        smallest_expected = std::min(smallest_expected, expected);
+    }
+    // About a 1e-4 tail for the degrees of freedom used here.
+    const double dof = static_cast<double>(classes.size()) - 1;
+    const double bound = dof + 4 * std::sqrt(2 * dof) + 10;
+    std::cout << classes.size() << " classes, " << samples << " samples, " << sampler.attempts()
+              << " candidates drawn; chi-square " << chi_square << " (bound " << bound << ", smallest expected count "
+              << smallest_expected << ")\n";
+    if (chi_square > bound) {
+        std::cerr << "FAIL class frequencies are not labelled-uniform\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Server check: malformed requests are answered with "ok":false and leave the
+// server running, and over a socket an idle client neither starves later
+// clients of a one-thread pool nor keeps the server alive after "shutdown".
+//
+// usage: server_requests <socket path>
+
+#include "server.hpp"
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const std::string& what, const std::string& response) {
+    if (!condition) {
+        std::cerr << "FAIL " << what << ": " << response << "\n";
+        ++failures;
+    }
+}
+
+bool contains(const std::string& s, const std::string& part) { return s.find(part) != std::string::npos; }
+
+int connect_to(const std::string& path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    for (int attempt = 0; attempt < 100; ++attempt) { // the server may not be listening yet
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) return fd;
+        ::usleep(50000);
+    }
+    ::close(fd);
+    return -1;
+}
+
+// One response line, or "" if none arrives within five seconds.
+std::string request(int fd, const std::string& line) {
+    const std::string data = line + "\n";
+    if (::send(fd, data.data(), data.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(data.size())) return "";
+    std::string response;
+    char c;
+    pollfd p{fd, POLLIN, 0};
+    while (::poll(&p, 1, 5000) == 1 && ::recv(fd, &c, 1, 0) == 1) {
+        if (c == '\n') return response;
+        response += c;
+    }
+    return "";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: server_requests <socket path>\n";
+        return 2;
+    }
+
+    std::istringstream in(R"({"op":"count","order":1,"tag":"\uZZZZ"}
+{"op":"count","order":1,"tag":"\u00"}
+{"op":"count","order":1,"tag":"A"}
+)");
+    std::ostringstream out;
+    serve_stream(in, out);
+    std::vector<std::string> responses;
+    std::istringstream lines(out.str());
+    for (std::string line; std::getline(lines, line);) responses.push_back(line);
+    if (responses.size() != 3) {
+        std::cerr << "FAIL expected 3 stream responses, got " << responses.size() << "\n";
+        return 1;
+    }
+    expect(contains(responses[0], "\"ok\":false") && contains(responses[0], "invalid \\\\u escape"), "non-hex escape",
+           responses[0]);
+    expect(contains(responses[1], "\"ok\":false") && contains(responses[1], "\\\\u escape"), "truncated escape",
+           responses[1]);
+    expect(contains(responses[2], "\"ok\":true") && contains(responses[2], "\"tag\":\"A\""), "valid escape",
+           responses[2]);
+
+    ServerOptions options;
+    options.socket_path = argv[1];
+    options.threads = 1;
+    auto server = std::async(std::launch::async, [&options] { return run_server(options); });
+    const int idle = connect_to(options.socket_path);
+    const int client = connect_to(options.socket_path);
+    if (idle < 0 || client < 0) {
+        std::cerr << "FAIL cannot connect to " << options.socket_path << "\n";
+        std::_Exit(1);
+    }
+    request(idle, R"({"op":"stats"})"); // the idle client has been served once and stays open
+    std::string response = request(client, R"({"op":"count","order":1})");
+    expect(contains(response, "\"count\":2"), "second client with one thread", response);
+    response = request(client, R"({"op":"count","order":1,"tag":"\uZZZZ"})");
+    expect(contains(response, "\"ok\":false"), "socket malformed escape", response);
+    response = request(client, R"({"op":"shutdown"})");
+    expect(contains(response, "\"ok\":true"), "shutdown", response);
+    if (server.wait_for(std::chrono::seconds(10)) != std::future_status::ready) {
+        std::cerr << "FAIL server still running with an idle client after shutdown\n";
+        std::_Exit(1); // the server thread cannot be joined
+    }
+    ::close(idle);
+    ::close(client);
+
+    std::cout << "server requests: " << (failures ? "FAILED" : "ok") << "\n";
+    return failures ? 1 : 0;
+}